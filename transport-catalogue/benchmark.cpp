@@ -0,0 +1,195 @@
+#include "benchmark.h"
+#include "transport_router.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace transport;
+using namespace std::literals;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
+    // Шаг сетки — около 330 м по широте и по долготе
+    const double GRID_LATITUDE = 55.0;
+    const double GRID_LONGITUDE = 37.0;
+    const double GRID_LATITUDE_STEP = 0.003;
+    const double GRID_LONGITUDE_STEP = 0.005;
+
+    const int BENCHMARK_BUS_WAIT_TIME = 5;
+    const double BENCHMARK_BUS_VELOCITY = 30.0;
+
+    RenderSettings MakeBenchmarkRenderSettings()
+    {
+        RenderSettings settings;
+        settings.width = 1200.0;
+        settings.height = 1200.0;
+        settings.padding = 50.0;
+        settings.line_width = 14.0;
+        settings.stop_radius = 5.0;
+        settings.underlayer_width = 3.0;
+        settings.bus_label_font_size = 20;
+        settings.stop_label_font_size = 20;
+        settings.bus_label_offset = {7.0, 15.0};
+        settings.stop_label_offset = {7.0, -3.0};
+        settings.underlayer_color = svg::Rgba{255, 255, 255, 0.85};
+        settings.color_palette = {svg::Color{"green"s}, svg::Rgb{255, 160, 0}, svg::Color{"red"s}};
+        return settings;
+    }
+
+    template <typename Func>
+    Milliseconds MeasureMedian(int repeat_count, Func func)
+    {
+        std::vector<Milliseconds> times;
+        for (int i = 0; i < repeat_count; ++i)
+        {
+            const auto start = Clock::now();
+            func();
+            times.push_back(Clock::now() - start);
+        }
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+}
+
+Catalogue transport::MakeSyntheticCity(const SyntheticCitySettings& settings)
+{
+    if (settings.stop_count < 2 || settings.route_size < 2)
+    {
+        throw std::invalid_argument("Synthetic city needs at least two stops and two stops per route");
+    }
+
+    const size_t width = size_t(std::ceil(std::sqrt(double(settings.stop_count))));
+    std::mt19937 random(settings.seed);
+
+    Catalogue catalogue;
+    catalogue.Reserve(settings.stop_count, settings.bus_count * settings.route_size);
+    for (size_t stop_id = 0; stop_id < settings.stop_count; ++stop_id)
+    {
+        catalogue.AddStop("s"s + std::to_string(stop_id),
+                          {GRID_LATITUDE + double(stop_id / width) * GRID_LATITUDE_STEP,
+                           GRID_LONGITUDE + double(stop_id % width) * GRID_LONGITUDE_STEP});
+    }
+
+    std::vector<Catalogue::BusInput> buses(settings.bus_count);
+    for (size_t bus_id = 0; bus_id < settings.bus_count; ++bus_id)
+    {
+        auto& bus = buses[bus_id];
+        bus.name = "b"s + std::to_string(bus_id);
+
+        // Шаг за край сетки или в несуществующий узел последнего ряда пропускается
+        size_t stop_id = random() % settings.stop_count;
+        bus.stops_names.push_back(catalogue.GetStopName(stop_id));
+        for (size_t step = 1; step < settings.route_size; ++step)
+        {
+            const size_t row = stop_id / width, column = stop_id % width;
+            size_t next = stop_id;
+            switch (random() % 4)
+            {
+                case 0: next = column + 1 < width ? stop_id + 1 : stop_id; break;
+                case 1: next = column > 0 ? stop_id - 1 : stop_id; break;
+                case 2: next = stop_id + width; break;
+                default: next = row > 0 ? stop_id - width : stop_id; break;
+            }
+            if (next == stop_id || next >= settings.stop_count)
+            {
+                continue;
+            }
+
+            const std::string_view from = catalogue.GetStopName(stop_id);
+            const std::string_view to = catalogue.GetStopName(next);
+            catalogue.SetStopsDistance(from, to, int(400 + (stop_id * 7 + next) % 300));
+            bus.stops_names.push_back(to);
+            stop_id = next;
+        }
+    }
+    catalogue.AddBuses(buses);
+    return catalogue;
+}
+
+MapBenchmarkReport transport::RunMapBenchmark(const CatalogueReader& catalogue, int repeat_count)
+{
+    if (repeat_count <= 0)
+    {
+        throw std::invalid_argument("Benchmark needs a positive number of repeats");
+    }
+
+    const RenderSettings settings = MakeBenchmarkRenderSettings();
+    MapBenchmarkReport report;
+
+    report.svg_time = MeasureMedian(repeat_count, [&] {
+        const MapRenderer renderer(settings);
+        std::ostringstream output;
+        renderer.Render(catalogue, output);
+        report.svg_bytes = output.str().size();
+    });
+
+    report.tile_time = MeasureMedian(repeat_count, [&] {
+        const MapRenderer renderer(settings);
+        report.tile_bytes = renderer.RenderTile(catalogue).size();
+    });
+
+    return report;
+}
+
+MatrixBenchmarkReport transport::RunMatrixBenchmark(const CatalogueReader& catalogue, size_t size, int repeat_count,
+                                                    uint32_t seed)
+{
+    if (repeat_count <= 0 || size == 0)
+    {
+        throw std::invalid_argument("Benchmark needs a positive number of repeats and a non-empty matrix");
+    }
+
+    std::vector<bool> is_served(catalogue.GetStopCount(), false);
+    catalogue.ForEachRoute([&is_served](const Route& route) {
+        for (const size_t stop_id : route.stop_ids)
+        {
+            is_served[stop_id] = true;
+        }
+    });
+    std::vector<size_t> served;
+    for (size_t stop_id = 0; stop_id < is_served.size(); ++stop_id)
+    {
+        if (is_served[stop_id])
+        {
+            served.push_back(stop_id);
+        }
+    }
+    if (served.empty())
+    {
+        throw std::invalid_argument("Benchmark city has no routes");
+    }
+
+    // Остановки берутся без повторов, пока их хватает
+    std::mt19937 random(seed);
+    auto sample = [&random, &served, size] {
+        std::shuffle(served.begin(), served.end(), random);
+        std::vector<size_t> stops;
+        stops.reserve(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            stops.push_back(served[i % served.size()]);
+        }
+        return stops;
+    };
+    const auto sources = sample();
+    const auto targets = sample();
+
+    TransportRouter router;
+    router.SetRoutingSettings({BENCHMARK_BUS_WAIT_TIME, BENCHMARK_BUS_VELOCITY});
+    router.ComputeTravelTimes(catalogue, {}, targets, [](size_t, std::vector<double>) {});
+
+    MatrixBenchmarkReport report;
+    report.cell_count = sources.size() * targets.size();
+    report.time = MeasureMedian(repeat_count, [&] {
+        router.ComputeTravelTimes(catalogue, sources, targets, [](size_t, std::vector<double>) {});
+    });
+    report.cells_per_second = report.time.count() > 0.0 ? report.cell_count / (report.time.count() / 1000.0) : 0.0;
+    return report;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "map_renderer.h"
+#include "transport_catalogue.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace transport
+{
+    // Синтетический город: остановки в узлах квадратной сетки, каждый автобус — некольцевой маршрут
+    // из route_size шагов случайного блуждания по соседним узлам. Для каждого отрезка маршрута задано
+    // дорожное расстояние, так что город годится и для карты, и для маршрутизации
+    struct SyntheticCitySettings
+    {
+        size_t stop_count = 20000;
+        size_t bus_count = 2000;
+        size_t route_size = 40;
+        uint32_t seed = 1;
+    };
+
+    Catalogue MakeSyntheticCity(const SyntheticCitySettings& settings);
+
+    struct MapBenchmarkReport
+    {
+        size_t svg_bytes = 0;
+        size_t tile_bytes = 0;
+        std::chrono::duration<double, std::milli> svg_time{};
+        std::chrono::duration<double, std::milli> tile_time{};
+    };
+
+    // Сравнивает карту в SVG и в бинарном тайле. Каждый замер идёт на новом MapRenderer, поэтому
+    // в него входит построение раскладки; время — медиана repeat_count замеров
+    MapBenchmarkReport RunMapBenchmark(const CatalogueReader& catalogue, int repeat_count);
+
+    struct MatrixBenchmarkReport
+    {
+        size_t cell_count = 0;
+        std::chrono::duration<double, std::milli> time{};
+        double cells_per_second = 0.0;
+    };
+
+    // Считает матрицу времени в пути size x size между случайными остановками, через которые идут автобусы.
+    // Граф маршрутизации строится до замеров; время — медиана repeat_count замеров
+    MatrixBenchmarkReport RunMatrixBenchmark(const CatalogueReader& catalogue, size_t size, int repeat_count,
+                                             uint32_t seed);
+}
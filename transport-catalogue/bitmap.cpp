@@ -0,0 +1,74 @@
+#include "bitmap.h"
+#include <algorithm>
+
+namespace transport {
+
+    SparseBitmap::SparseBitmap(const std::vector<uint32_t>& positions) {
+        for (const uint32_t position : positions) {
+            const uint32_t word_index = position / 64;
+            if (word_indexes_.empty() || word_indexes_.back() != word_index) {
+                word_indexes_.push_back(word_index);
+                words_.push_back(0);
+            }
+            words_.back() |= uint64_t(1) << (position % 64);
+        }
+    }
+
+    bool SparseBitmap::Contains(uint32_t position) const {
+        const auto it = std::lower_bound(word_indexes_.begin(), word_indexes_.end(), position / 64);
+        if (it == word_indexes_.end() || *it != position / 64) {
+            return false;
+        }
+        return (words_[it - word_indexes_.begin()] >> (position % 64)) & 1;
+    }
+
+    size_t SparseBitmap::Count() const {
+        size_t count = 0;
+        for (const uint64_t word : words_) {
+            count += __builtin_popcountll(word);
+        }
+        return count;
+    }
+
+    bool SparseBitmap::Empty() const {
+        return words_.empty();
+    }
+
+    SparseBitmap SparseBitmap::And(const SparseBitmap& other) const {
+        SparseBitmap result;
+        size_t i = 0, j = 0;
+        while (i < word_indexes_.size() && j < other.word_indexes_.size()) {
+            if (word_indexes_[i] < other.word_indexes_[j]) {
+                ++i;
+            }
+            else if (other.word_indexes_[j] < word_indexes_[i]) {
+                ++j;
+            }
+            else {
+                if (const uint64_t word = words_[i] & other.words_[j]) {
+                    result.word_indexes_.push_back(word_indexes_[i]);
+                    result.words_.push_back(word);
+                }
+                ++i;
+                ++j;
+            }
+        }
+        return result;
+    }
+
+    bool SparseBitmap::Intersects(const std::vector<uint64_t>& dense) const {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            if (words_[i] & dense[word_indexes_[i]]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void SparseBitmap::OrInto(std::vector<uint64_t>& dense) const {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            dense[word_indexes_[i]] |= words_[i];
+        }
+    }
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace transport {
+
+    // Разреженная битовая карта: только ненулевые 64-битные слова вместе с их номерами, по возрастанию
+    // номеров. Пересечение и объединение идут сразу по 64 позиции за операцию, а пустые участки
+    // не занимают места, поэтому карта компактна и для остановки с парой автобусов, и для узловой
+    class SparseBitmap {
+    public:
+        SparseBitmap() = default;
+
+        // positions должны быть упорядочены по возрастанию; повторы допустимы
+        explicit SparseBitmap(const std::vector<uint32_t>& positions);
+
+        bool Contains(uint32_t position) const;
+
+        size_t Count() const;
+
+        bool Empty() const;
+
+        SparseBitmap And(const SparseBitmap& other) const;
+
+        // Есть ли общие позиции с плотной битовой картой dense
+        bool Intersects(const std::vector<uint64_t>& dense) const;
+
+        // Объединяет карту с плотной битовой картой dense, где слово i — позиции [64 * i, 64 * i + 64)
+        void OrInto(std::vector<uint64_t>& dense) const;
+
+        template <typename Func>
+        void ForEach(Func func) const {
+            for (size_t i = 0; i < words_.size(); ++i) {
+                for (uint64_t word = words_[i]; word != 0; word &= word - 1) {
+                    func(uint32_t(word_indexes_[i] * 64 + __builtin_ctzll(word)));
+                }
+            }
+        }
+
+        // Вызывает func(word_index, word) для каждого ненулевого слова по возрастанию номеров
+        template <typename Func>
+        void ForEachWord(Func func) const {
+            for (size_t i = 0; i < words_.size(); ++i) {
+                func(word_indexes_[i], words_[i]);
+            }
+        }
+
+    private:
+        std::vector<uint32_t> word_indexes_;
+        std::vector<uint64_t> words_;
+    };
+
+    // Вызывает func для каждой позиции плотной битовой карты по возрастанию
+    template <typename Func>
+    void ForEachBit(const std::vector<uint64_t>& dense, Func func) {
+        for (size_t i = 0; i < dense.size(); ++i) {
+            for (uint64_t word = dense[i]; word != 0; word &= word - 1) {
+                func(uint32_t(i * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+
+}
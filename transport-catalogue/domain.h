@@ -1,20 +1,51 @@
 #pragma once
 #include "geo.h"
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <optional>
 #include <string_view>
 
 namespace transport {
     struct Stop {
         std::string name;
         Coordinates coordinates;
+        size_t id = 0;
     };
 
     struct Bus {
         std::string name;
         bool is_roundtrip;
-        std::vector<const Stop*> bus_stops;
+        // Остановки заданы своими Stop::id, поэтому изменение остановки не затрагивает маршруты
+        std::vector<size_t> stop_ids;
+        size_t id = 0;
+        // Отправления рейсов с начальной остановки, минуты от начала суток по возрастанию; пусто — без расписания
+        std::vector<double> departures;
+    };
+
+    // Компактная геометрия остановок для массовых расчётов расстояний, индекс — Stop::id. Вместо объектов
+    // остановок в куче — два плотных массива: координаты в фиксированной точке (8 байт на остановку) и
+    // вычисленные по ним единичные векторы (24 байта), так что расстояние не требует синусов и косинусов
+    struct StopGeometry {
+        std::vector<FixedCoordinates> coordinates;
+        std::vector<UnitVector> unit_vectors;
+
+        void Set(size_t stop_id, Coordinates stop_coordinates) {
+            if (stop_id >= coordinates.size()) {
+                coordinates.resize(stop_id + 1);
+                unit_vectors.resize(stop_id + 1);
+            }
+            coordinates[stop_id] = ToFixedCoordinates(stop_coordinates);
+            unit_vectors[stop_id] = ToUnitVector(ToCoordinates(coordinates[stop_id]));
+        }
+
+        double ComputeDistance(size_t stop_id_from, size_t stop_id_to) const {
+            return transport::ComputeDistance(unit_vectors[stop_id_from], unit_vectors[stop_id_to]);
+        }
     };
 
     struct BusInfo {
@@ -25,8 +56,158 @@ namespace transport {
 
     };
 
+    // Названия автобусов без копирования: отрезок массива id автобусов и таблица названий по id
+    class BusNamesView {
+    public:
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const std::string_view*;
+            using reference = const std::string_view&;
+
+            Iterator() = default;
+
+            Iterator(const uint32_t* bus_id, const std::string_view* names)
+                : bus_id_(bus_id), names_(names) {
+            }
+
+            reference operator*() const {
+                return names_[*bus_id_];
+            }
+
+            pointer operator->() const {
+                return &names_[*bus_id_];
+            }
+
+            Iterator& operator++() {
+                ++bus_id_;
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                Iterator prev = *this;
+                ++bus_id_;
+                return prev;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return bus_id_ == other.bus_id_;
+            }
+
+            bool operator!=(const Iterator& other) const {
+                return bus_id_ != other.bus_id_;
+            }
+
+        private:
+            const uint32_t* bus_id_ = nullptr;
+            const std::string_view* names_ = nullptr;
+        };
+
+        BusNamesView() = default;
+
+        BusNamesView(const uint32_t* first, const uint32_t* last, const std::string_view* names)
+            : first_(first), last_(last), names_(names) {
+        }
+
+        Iterator begin() const {
+            return {first_, names_};
+        }
+
+        Iterator end() const {
+            return {last_, names_};
+        }
+
+        size_t size() const {
+            return last_ - first_;
+        }
+
+        bool empty() const {
+            return first_ == last_;
+        }
+
+    private:
+        const uint32_t* first_ = nullptr;
+        const uint32_t* last_ = nullptr;
+        const std::string_view* names_ = nullptr;
+    };
+
+    // Рейтинги и итоги по всей сети для одной версии справочника. Рейтинги упорядочены заранее,
+    // поэтому ответ на запрос первых K — срез готового массива
+    struct NetworkStats {
+        struct StopRank {
+            std::string_view name;
+            size_t bus_count = 0;
+        };
+
+        // Статистика маршрутов в порядке названий; маршруты без заданных расстояний не входят
+        std::vector<BusInfo> buses;
+        // Индексы в buses по убыванию длины маршрута и по убыванию извилистости, при равенстве — по названию
+        std::vector<uint32_t> buses_by_length;
+        std::vector<uint32_t> buses_by_curvature;
+        // Остановки, через которые проходят автобусы, по убыванию числа автобусов, при равенстве — по названию
+        std::vector<StopRank> stops_by_bus_count;
+
+        size_t bus_count = 0;
+        size_t stop_count = 0;
+        int64_t total_route_length = 0;
+        int64_t total_stops_on_route = 0;
+    };
+
     struct StopInfo {
         std::string_view name;
-        const std::set<std::string_view>& buses_names;
+        // Названия автобусов в порядке возрастания. Действительны, пока справочник не изменится
+        BusNamesView buses_names;
+        size_t id = 0;
+    };
+
+    // Маршрут в виде, не зависящем от способа хранения справочника: остановки заданы своими Stop::id
+    struct Route {
+        std::string_view name;
+        bool is_roundtrip = false;
+        std::vector<size_t> stop_ids;
+        std::vector<double> departures;
+    };
+
+    // Пакет изменений уже построенного справочника
+    struct CatalogueDelta {
+        struct StopChange {
+            std::string name;
+            // Пусто — удалить остановку
+            std::optional<Coordinates> coordinates;
+            std::map<std::string, int> road_distances;
+        };
+
+        struct DistanceChange {
+            std::string from;
+            std::string to;
+            // Пусто — удалить расстояние
+            std::optional<int> distance;
+        };
+
+        struct BusChange {
+            std::string name;
+            // Пусто — удалить маршрут
+            std::optional<std::vector<std::string>> stops;
+            bool is_roundtrip = false;
+            std::vector<double> departures;
+        };
+
+        std::vector<StopChange> stops;
+        std::vector<DistanceChange> distances;
+        std::vector<BusChange> buses;
+    };
+
+    // Производные данные, устаревшие после применения CatalogueDelta
+    struct DeltaReport {
+        // Маршруты, у которых могли измениться статистика и отрисовка
+        std::set<std::string> buses;
+        // Остановки, у которых изменились координаты или список автобусов
+        std::set<std::string> stops;
+        // Изменилось что-то, что видно на карте
+        bool map_changed = false;
+        // Ошибочные элементы пакета; если они есть, справочник не изменён
+        std::vector<std::string> errors;
     };
-}
\ No newline at end of file
+}
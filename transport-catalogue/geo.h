@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 
 namespace transport {
     const int RADIUS = 6371000;
@@ -25,4 +27,41 @@ namespace transport {
                     + cos(from.lat * dr) * cos(to.lat * dr) * cos(abs(from.lng - to.lng) * dr))
                * RADIUS;
     }
+
+    // Координаты в фиксированной точке: 1e-7 градуса, то есть не больше 1.1 см
+    struct FixedCoordinates {
+        int32_t lat = 0;
+        int32_t lng = 0;
+    };
+
+    const double FIXED_COORDINATES_SCALE = 1e7;
+
+    inline FixedCoordinates ToFixedCoordinates(Coordinates coordinates) {
+        return {int32_t(std::lround(coordinates.lat * FIXED_COORDINATES_SCALE)),
+                int32_t(std::lround(coordinates.lng * FIXED_COORDINATES_SCALE))};
+    }
+
+    inline Coordinates ToCoordinates(FixedCoordinates coordinates) {
+        return {coordinates.lat / FIXED_COORDINATES_SCALE, coordinates.lng / FIXED_COORDINATES_SCALE};
+    }
+
+    // Точка на единичной сфере. Скалярное произведение двух векторов равно косинусу угла между
+    // точками, поэтому расстояние считается без тригонометрии, кроме одного acos
+    struct UnitVector {
+        double x = 0.0;
+        double y = 0.0;
+        double z = 0.0;
+    };
+
+    inline UnitVector ToUnitVector(Coordinates coordinates) {
+        static const double dr = M_PI / 180.;
+        const double cos_lat = std::cos(coordinates.lat * dr);
+        return {cos_lat * std::cos(coordinates.lng * dr), cos_lat * std::sin(coordinates.lng * dr), std::sin(coordinates.lat * dr)};
+    }
+
+    inline double ComputeDistance(const UnitVector& from, const UnitVector& to) {
+        const double dot = from.x * to.x + from.y * to.y + from.z * to.z;
+        // Из-за округления у совпадающих точек произведение может чуть превысить 1
+        return std::acos(std::min(dot, 1.0)) * RADIUS;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "incidence.h"
+#include "transport_catalogue.h"
+#include "parallel.h"
+#include <algorithm>
+
+namespace transport {
+
+    StopBusIncidence::StopBusIncidence(const CatalogueReader& catalogue) {
+        std::vector<std::vector<size_t>> routes_stop_ids;
+        catalogue.ForEachRoute([&](Route route) {
+            bus_names_.push_back(route.name);
+            routes_stop_ids.push_back(std::move(route.stop_ids));
+        });
+
+        // Ранги получают только остановки маршрутов: у остальных нет ни одного бита
+        stop_ranks_.assign(catalogue.GetStopCount(), NO_RANK);
+        for (const auto& stop_ids : routes_stop_ids) {
+            for (const size_t stop_id : stop_ids) {
+                if (stop_ranks_[stop_id] == NO_RANK) {
+                    stop_ranks_[stop_id] = 0;
+                    stop_ids_.push_back(stop_id);
+                }
+            }
+        }
+        std::sort(stop_ids_.begin(), stop_ids_.end(), [&catalogue](size_t lhs, size_t rhs) {
+            return catalogue.GetStopName(lhs) < catalogue.GetStopName(rhs);
+        });
+        for (size_t rank = 0; rank < stop_ids_.size(); ++rank) {
+            stop_ranks_[stop_ids_[rank]] = uint32_t(rank);
+        }
+
+        // Автобусы перебираются по возрастанию рангов, поэтому списки автобусов остановок уже упорядочены
+        std::vector<std::vector<uint32_t>> stops_bus_ranks(stop_ids_.size());
+        for (size_t bus_rank = 0; bus_rank < routes_stop_ids.size(); ++bus_rank) {
+            for (const size_t stop_id : routes_stop_ids[bus_rank]) {
+                auto& bus_ranks = stops_bus_ranks[stop_ranks_[stop_id]];
+                if (bus_ranks.empty() || bus_ranks.back() != bus_rank) {
+                    bus_ranks.push_back(uint32_t(bus_rank));
+                }
+            }
+        }
+
+        stop_buses_.resize(stop_ids_.size());
+        ParallelFor(stop_ids_.size(), [&](size_t stop_rank) {
+            stop_buses_[stop_rank] = SparseBitmap(stops_bus_ranks[stop_rank]);
+        });
+
+        bus_stops_.resize(routes_stop_ids.size());
+        ParallelFor(routes_stop_ids.size(), [&](size_t bus_rank) {
+            std::vector<uint32_t> stop_ranks;
+            stop_ranks.reserve(routes_stop_ids[bus_rank].size());
+            for (const size_t stop_id : routes_stop_ids[bus_rank]) {
+                stop_ranks.push_back(stop_ranks_[stop_id]);
+            }
+            std::sort(stop_ranks.begin(), stop_ranks.end());
+            bus_stops_[bus_rank] = SparseBitmap(stop_ranks);
+        });
+    }
+
+    std::vector<std::string_view> StopBusIncidence::GetDirectBuses(size_t stop_id_from, size_t stop_id_to) const {
+        const uint32_t rank_from = GetStopRank(stop_id_from);
+        const uint32_t rank_to = GetStopRank(stop_id_to);
+        std::vector<std::string_view> result;
+        if (rank_from == NO_RANK || rank_to == NO_RANK) {
+            return result;
+        }
+
+        stop_buses_[rank_from].And(stop_buses_[rank_to]).ForEach([this, &result](uint32_t bus_rank) {
+            result.push_back(bus_names_[bus_rank]);
+        });
+        return result;
+    }
+
+    std::vector<size_t> StopBusIncidence::GetCoServedStops(size_t stop_id) const {
+        const uint32_t stop_rank = GetStopRank(stop_id);
+        std::vector<size_t> result;
+        if (stop_rank == NO_RANK) {
+            return result;
+        }
+
+        std::vector<uint64_t> stops((stop_ids_.size() + 63) / 64, 0);
+        stop_buses_[stop_rank].ForEach([this, &stops](uint32_t bus_rank) {
+            bus_stops_[bus_rank].OrInto(stops);
+        });
+        stops[stop_rank / 64] &= ~(uint64_t(1) << (stop_rank % 64));
+
+        ForEachBit(stops, [this, &result](uint32_t rank) {
+            result.push_back(stop_ids_[rank]);
+        });
+        return result;
+    }
+
+    size_t StopBusIncidence::GetBusCount() const {
+        return bus_names_.size();
+    }
+
+    size_t StopBusIncidence::GetStopCount() const {
+        return stop_ids_.size();
+    }
+
+    uint32_t StopBusIncidence::GetStopRank(size_t stop_id) const {
+        // Остановки, добавленные после построения, ещё не обслуживаются автобусами
+        return stop_id < stop_ranks_.size() ? stop_ranks_[stop_id] : NO_RANK;
+    }
+
+    size_t StopBusIncidence::GetStopId(uint32_t stop_rank) const {
+        return stop_ids_[stop_rank];
+    }
+
+    std::string_view StopBusIncidence::GetBusName(uint32_t bus_rank) const {
+        return bus_names_[bus_rank];
+    }
+
+    const SparseBitmap& StopBusIncidence::GetStopBuses(uint32_t stop_rank) const {
+        return stop_buses_[stop_rank];
+    }
+
+    const SparseBitmap& StopBusIncidence::GetBusStops(uint32_t bus_rank) const {
+        return bus_stops_[bus_rank];
+    }
+
+}
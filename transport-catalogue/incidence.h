@@ -0,0 +1,56 @@
+#pragma once
+#include "bitmap.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace transport {
+
+    class CatalogueReader;
+
+    // Матрица инцидентности «остановка × автобус» в двух направлениях: для каждой остановки — битовая
+    // карта её автобусов, для каждого автобуса — битовая карта его остановок. Автобусы и остановки
+    // занумерованы в порядке названий (рангами), поэтому биты результата сразу перечисляются
+    // по алфавиту. Учитываются только остановки, через которые проходят автобусы. Названия остановок
+    // не хранятся: объект остановки заменяется при изменении координат, а Stop::id остаётся
+    class StopBusIncidence {
+    public:
+        StopBusIncidence() = default;
+
+        explicit StopBusIncidence(const CatalogueReader& catalogue);
+
+        // Автобусы, проходящие через обе остановки, в порядке названий
+        std::vector<std::string_view> GetDirectBuses(size_t stop_id_from, size_t stop_id_to) const;
+
+        // Stop::id остановок, связанных с данной хотя бы одним автобусом, кроме неё самой, в порядке названий
+        std::vector<size_t> GetCoServedStops(size_t stop_id) const;
+
+        size_t GetBusCount() const;
+
+        size_t GetStopCount() const;
+
+        // Ранг остановки по её Stop::id или NO_RANK, если через остановку не проходят автобусы
+        uint32_t GetStopRank(size_t stop_id) const;
+
+        size_t GetStopId(uint32_t stop_rank) const;
+
+        std::string_view GetBusName(uint32_t bus_rank) const;
+
+        // Ранги автобусов остановки с рангом stop_rank
+        const SparseBitmap& GetStopBuses(uint32_t stop_rank) const;
+
+        // Ранги остановок автобуса с рангом bus_rank
+        const SparseBitmap& GetBusStops(uint32_t bus_rank) const;
+
+        static constexpr uint32_t NO_RANK = UINT32_MAX;
+
+    private:
+        std::vector<std::string_view> bus_names_;
+        std::vector<size_t> stop_ids_;
+        std::vector<uint32_t> stop_ranks_;
+        std::vector<SparseBitmap> stop_buses_;
+        std::vector<SparseBitmap> bus_stops_;
+    };
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "transport_catalogue.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace transport
+{
+    // Индекс, построенный по справочнику: строится при первом обращении и перестраивается, когда
+    // запрос приходит с другим справочником или другой его версией. Построение идёт под блокировкой,
+    // поэтому одновременные запросы дожидаются одного построения, а уже выданный индекс остаётся
+    // у тех, кто его держит
+    template <typename Index>
+    class CatalogueIndexCache
+    {
+    public:
+        explicit CatalogueIndexCache(std::string_view name)
+            : name_(name)
+        {
+        }
+
+        // build(catalogue) возвращает std::shared_ptr<const Index> и вызывается под блокировкой кэша
+        template <typename Build>
+        std::shared_ptr<const Index> Get(const CatalogueReader& catalogue, Build build) const
+        {
+            std::lock_guard guard(mutex_);
+
+            if (index_ && catalogue_ == &catalogue && catalogue_version_ == catalogue.GetVersion())
+            {
+                return index_;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            index_ = build(catalogue);
+            catalogue_ = &catalogue;
+            catalogue_version_ = catalogue.GetVersion();
+            build_time_ += std::chrono::steady_clock::now() - start;
+            ++build_count_;
+            return index_;
+        }
+
+        // Под блокировкой кэша вызывает update, например меняя настройки построения, и сбрасывает индекс
+        template <typename Update>
+        void Reset(Update update)
+        {
+            std::lock_guard guard(mutex_);
+            update();
+            index_.reset();
+        }
+
+        IndexBuildStats GetStats() const
+        {
+            std::lock_guard guard(mutex_);
+            return {name_, index_ != nullptr, build_count_, build_time_};
+        }
+
+    private:
+        std::string_view name_;
+        mutable std::mutex mutex_;
+        mutable std::shared_ptr<const Index> index_;
+        mutable const CatalogueReader* catalogue_ = nullptr;
+        mutable uint64_t catalogue_version_ = 0;
+        mutable size_t build_count_ = 0;
+        mutable std::chrono::nanoseconds build_time_{};
+    };
+
+    // Состояния поиска, которые переиспользуются между запросами, чтобы повторные поиски не выделяли
+    // память. Каждый поток берёт своё состояние и возвращает его после поиска
+    template <typename State>
+    class SearchStatePool
+    {
+    public:
+        std::unique_ptr<State> Acquire() const
+        {
+            std::lock_guard guard(mutex_);
+
+            if (free_states_.empty())
+            {
+                return std::make_unique<State>();
+            }
+
+            auto state = std::move(free_states_.back());
+            free_states_.pop_back();
+            return state;
+        }
+
+        void Release(std::unique_ptr<State> state) const
+        {
+            std::lock_guard guard(mutex_);
+            free_states_.push_back(std::move(state));
+        }
+
+    private:
+        mutable std::mutex mutex_;
+        mutable std::vector<std::unique_ptr<State>> free_states_;
+    };
+}
@@ -0,0 +1,381 @@
+#include "journey_planner.h"
+#include "parallel.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+using namespace transport;
+using namespace std::literals;
+
+namespace
+{
+    const double INFINITE_TIME = std::numeric_limits<double>::infinity();
+    const uint32_t NO_POSITION = std::numeric_limits<uint32_t>::max();
+}
+
+// Все массивы упорядочены по маршрутам, чтобы просмотр маршрута читал память подряд
+struct JourneyPlanner::Timetable
+{
+    size_t stop_count = 0;
+    std::vector<std::string_view> bus_names;
+    // Остановки маршрута r — route_stops[route_offsets[r], route_offsets[r + 1]), в stop_times по тем же
+    // индексам — время от отправления рейса до прибытия на остановку
+    std::vector<uint32_t> route_offsets;
+    std::vector<uint32_t> route_stops;
+    std::vector<double> stop_times;
+    // Отправления рейсов маршрута r — departures[departure_offsets[r], departure_offsets[r + 1])
+    std::vector<uint32_t> departure_offsets;
+    std::vector<double> departures;
+    // Пары (маршрут, позиция) для каждой остановки — stop_routes[stop_route_offsets[s], stop_route_offsets[s + 1])
+    std::vector<uint32_t> stop_route_offsets;
+    std::vector<std::pair<uint32_t, uint32_t>> stop_routes;
+};
+
+struct JourneyPlanner::SearchState
+{
+    struct Parent
+    {
+        uint32_t route;
+        uint32_t board_position;
+        uint32_t alight_position;
+        uint32_t trip;
+    };
+
+    // Метки раунда k для остановки s — labels[k * stop_count + s]; parents — по тем же индексам
+    size_t stop_count = 0;
+    std::vector<double> labels;
+    std::vector<Parent> parents;
+    std::vector<uint32_t> touched_labels;
+    std::vector<double> best;
+    std::vector<uint32_t> touched_stops;
+    std::vector<uint32_t> marked;
+    std::vector<bool> is_marked;
+    std::vector<uint32_t> queue_positions;
+    std::vector<uint32_t> queued_routes;
+
+    void Prepare(size_t timetable_stop_count, size_t route_count, size_t rounds)
+    {
+        if (stop_count != timetable_stop_count || queue_positions.size() != route_count)
+        {
+            stop_count = timetable_stop_count;
+            labels.assign(rounds * stop_count, INFINITE_TIME);
+            parents.resize(labels.size());
+            best.assign(stop_count, INFINITE_TIME);
+            is_marked.assign(stop_count, false);
+            queue_positions.assign(route_count, NO_POSITION);
+            touched_labels.clear();
+            touched_stops.clear();
+        }
+
+        for (const uint32_t index : touched_labels)
+        {
+            labels[index] = INFINITE_TIME;
+        }
+        for (const uint32_t stop : touched_stops)
+        {
+            best[stop] = INFINITE_TIME;
+        }
+        touched_labels.clear();
+        touched_stops.clear();
+        marked.clear();
+
+        if (labels.size() < rounds * stop_count)
+        {
+            labels.resize(rounds * stop_count, INFINITE_TIME);
+            parents.resize(labels.size());
+        }
+    }
+
+    void SetLabel(size_t round, uint32_t stop, double time)
+    {
+        const size_t index = round * stop_count + stop;
+        if (labels[index] == INFINITE_TIME)
+        {
+            touched_labels.push_back(uint32_t(index));
+        }
+        labels[index] = time;
+
+        if (best[stop] == INFINITE_TIME)
+        {
+            touched_stops.push_back(stop);
+        }
+        best[stop] = time;
+
+        if (!is_marked[stop])
+        {
+            is_marked[stop] = true;
+            marked.push_back(stop);
+        }
+    }
+};
+
+JourneyPlanner::JourneyPlanner()
+    : timetable_("timetable")
+{
+}
+
+JourneyPlanner::~JourneyPlanner() = default;
+
+void JourneyPlanner::SetRoutingSettings(RoutingSettings routing_settings)
+{
+    timetable_.Reset([&] {
+        routing_settings_ = std::move(routing_settings);
+    });
+}
+
+std::vector<Journey> JourneyPlanner::FindJourneys(const CatalogueReader& catalogue, const JourneyQuery& query,
+                                                  int max_transfers) const
+{
+    const auto timetable = GetTimetable(catalogue);
+    auto state = states_.Acquire();
+    auto journeys = Search(catalogue, *timetable, *state, query, max_transfers);
+    states_.Release(std::move(state));
+    return journeys;
+}
+
+std::vector<std::vector<Journey>> JourneyPlanner::FindJourneys(const CatalogueReader& catalogue,
+                                                               const std::vector<JourneyQuery>& queries,
+                                                               int max_transfers) const
+{
+    const auto timetable = GetTimetable(catalogue);
+    std::vector<std::vector<Journey>> result(queries.size());
+
+    ParallelForRanges(queries.size(), [&](size_t first, size_t last) {
+        auto state = states_.Acquire();
+        for (size_t i = first; i < last; ++i)
+        {
+            result[i] = Search(catalogue, *timetable, *state, queries[i], max_transfers);
+        }
+        states_.Release(std::move(state));
+    });
+
+    return result;
+}
+
+IndexBuildStats JourneyPlanner::GetTimetableStats() const
+{
+    return timetable_.GetStats();
+}
+
+std::vector<Journey> JourneyPlanner::Search(const CatalogueReader& catalogue, const Timetable& timetable,
+                                            SearchState& state, const JourneyQuery& query, int max_transfers) const
+{
+    std::vector<Journey> journeys;
+    if (query.from_stop_id == query.to_stop_id)
+    {
+        journeys.push_back({query.departure_time, 0, {}});
+        return journeys;
+    }
+    if (max_transfers < 0)
+    {
+        return journeys;
+    }
+
+    // На один маршрут дважды не садятся: остаться в первом рейсе не позже, а рейсы не обгоняют друг друга.
+    // Поэтому раундов с улучшениями не больше, чем маршрутов, и метки на большее число не выделяются
+    const size_t rounds = std::min(size_t(max_transfers) + 2, timetable.bus_names.size() + 1);
+    const uint32_t target = uint32_t(query.to_stop_id);
+    state.Prepare(timetable.stop_count, timetable.bus_names.size(), rounds);
+    state.SetLabel(0, uint32_t(query.from_stop_id), query.departure_time);
+
+    for (size_t round = 1; round < rounds && !state.marked.empty(); ++round)
+    {
+        // Каждый маршрут просматривается от самой ранней позиции, где отмечена остановка
+        for (const uint32_t stop : state.marked)
+        {
+            state.is_marked[stop] = false;
+            for (uint32_t i = timetable.stop_route_offsets[stop]; i < timetable.stop_route_offsets[stop + 1]; ++i)
+            {
+                const auto [route, position] = timetable.stop_routes[i];
+                if (state.queue_positions[route] == NO_POSITION)
+                {
+                    state.queued_routes.push_back(route);
+                    state.queue_positions[route] = position;
+                }
+                else
+                {
+                    state.queue_positions[route] = std::min(state.queue_positions[route], position);
+                }
+            }
+        }
+        state.marked.clear();
+
+        const double* previous_labels = state.labels.data() + (round - 1) * state.stop_count;
+
+        for (const uint32_t route : state.queued_routes)
+        {
+            const uint32_t route_first = timetable.route_offsets[route];
+            const uint32_t route_last = timetable.route_offsets[route + 1];
+            const double* departures_first = timetable.departures.data() + timetable.departure_offsets[route];
+            const double* departures_last = timetable.departures.data() + timetable.departure_offsets[route + 1];
+            const double* trip = nullptr;
+            uint32_t board_position = 0;
+
+            for (uint32_t i = route_first + state.queue_positions[route]; i < route_last; ++i)
+            {
+                const uint32_t stop = timetable.route_stops[i];
+                const double offset = timetable.stop_times[i];
+
+                // Прибытие засчитывается, только если оно раньше уже известного сюда и в цель
+                if (trip)
+                {
+                    const double arrival = *trip + offset;
+                    if (arrival < state.best[stop] && arrival < state.best[target])
+                    {
+                        state.SetLabel(round, stop, arrival);
+                        state.parents[round * state.stop_count + stop] = {
+                                route, board_position - route_first, i - route_first, uint32_t(trip - departures_first)};
+                    }
+                }
+
+                // Пересесть на более ранний рейс можно там, куда добрались в предыдущем раунде
+                const double ready_time = previous_labels[stop];
+                if (ready_time != INFINITE_TIME && (!trip || ready_time < *trip + offset))
+                {
+                    const double* earliest = std::lower_bound(departures_first, trip ? trip : departures_last, ready_time,
+                                                              [offset](double departure, double time) {
+                        return departure + offset < time;
+                    });
+                    if (earliest != (trip ? trip : departures_last))
+                    {
+                        trip = earliest;
+                        board_position = i;
+                    }
+                }
+            }
+
+            state.queue_positions[route] = NO_POSITION;
+        }
+        state.queued_routes.clear();
+    }
+
+    for (const uint32_t stop : state.marked)
+    {
+        state.is_marked[stop] = false;
+    }
+    state.marked.clear();
+
+    // Метка цели в раунде k есть, только если k рейсов дали прибытие раньше, чем меньшее число рейсов
+    for (size_t round = 1; round < rounds; ++round)
+    {
+        const double arrival_time = state.labels[round * state.stop_count + target];
+        if (arrival_time == INFINITE_TIME)
+        {
+            continue;
+        }
+
+        Journey journey{arrival_time, int(round) - 1, std::vector<JourneyLeg>(round)};
+        uint32_t stop = target;
+        for (size_t leg_round = round; leg_round > 0; --leg_round)
+        {
+            const auto& parent = state.parents[leg_round * state.stop_count + stop];
+            const uint32_t route_first = timetable.route_offsets[parent.route];
+            const double departure = timetable.departures[timetable.departure_offsets[parent.route] + parent.trip];
+            const uint32_t board_stop = timetable.route_stops[route_first + parent.board_position];
+
+            journey.legs[leg_round - 1] = {
+                    timetable.bus_names[parent.route],
+                    catalogue.GetStopName(board_stop),
+                    catalogue.GetStopName(stop),
+                    departure + timetable.stop_times[route_first + parent.board_position],
+                    departure + timetable.stop_times[route_first + parent.alight_position]};
+            stop = board_stop;
+        }
+        journeys.push_back(std::move(journey));
+    }
+
+    return journeys;
+}
+
+std::shared_ptr<const JourneyPlanner::Timetable> JourneyPlanner::GetTimetable(const CatalogueReader& catalogue) const
+{
+    return timetable_.Get(catalogue, [this](const CatalogueReader& reader) {
+        return BuildTimetable(reader);
+    });
+}
+
+std::shared_ptr<const JourneyPlanner::Timetable> JourneyPlanner::BuildTimetable(const CatalogueReader& catalogue) const
+{
+    if (!routing_settings_)
+    {
+        throw std::logic_error("Routing settings are not set"s);
+    }
+
+    auto timetable = std::make_shared<Timetable>();
+    timetable->stop_count = catalogue.GetStopCount();
+    timetable->route_offsets.push_back(0);
+    timetable->departure_offsets.push_back(0);
+
+    const double meters_per_minute = routing_settings_->GetMetersPerMinute();
+    std::vector<uint32_t> stop_route_counts(timetable->stop_count + 1, 0);
+
+    catalogue.ForEachRoute([&](Route route) {
+        if (route.departures.empty() || route.stop_ids.size() < 2)
+        {
+            return;
+        }
+
+        if (!route.is_roundtrip)
+        {
+            // Обратный путь дописывается по индексам: вставка диапазона из того же вектора не допускается
+            const size_t forward_size = route.stop_ids.size();
+            route.stop_ids.reserve(2 * forward_size - 1);
+            for (size_t i = forward_size - 1; i-- > 0;)
+            {
+                route.stop_ids.push_back(route.stop_ids[i]);
+            }
+        }
+
+        const size_t route_first = timetable->route_stops.size();
+        double time = 0.0;
+        for (size_t i = 0; i < route.stop_ids.size(); ++i)
+        {
+            if (i > 0)
+            {
+                const auto distance = catalogue.GetDistance(route.stop_ids[i - 1], route.stop_ids[i]);
+                if (!distance)
+                {
+                    break;
+                }
+                time += *distance / meters_per_minute;
+            }
+            timetable->route_stops.push_back(uint32_t(route.stop_ids[i]));
+            timetable->stop_times.push_back(time);
+        }
+
+        if (timetable->route_stops.size() - route_first < 2)
+        {
+            timetable->route_stops.resize(route_first);
+            timetable->stop_times.resize(route_first);
+            return;
+        }
+
+        for (size_t i = route_first; i < timetable->route_stops.size(); ++i)
+        {
+            ++stop_route_counts[timetable->route_stops[i] + 1];
+        }
+
+        timetable->bus_names.push_back(route.name);
+        timetable->route_offsets.push_back(uint32_t(timetable->route_stops.size()));
+        timetable->departures.insert(timetable->departures.end(), route.departures.begin(), route.departures.end());
+        timetable->departure_offsets.push_back(uint32_t(timetable->departures.size()));
+    });
+
+    for (size_t stop = 0; stop < timetable->stop_count; ++stop)
+    {
+        stop_route_counts[stop + 1] += stop_route_counts[stop];
+    }
+    timetable->stop_route_offsets = stop_route_counts;
+    timetable->stop_routes.resize(timetable->route_stops.size());
+
+    for (uint32_t route = 0; route + 1 < timetable->route_offsets.size(); ++route)
+    {
+        const uint32_t route_first = timetable->route_offsets[route];
+        for (uint32_t i = route_first; i < timetable->route_offsets[route + 1]; ++i)
+        {
+            timetable->stop_routes[stop_route_counts[timetable->route_stops[i]]++] = {route, i - route_first};
+        }
+    }
+
+    return timetable;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "index_cache.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace transport
+{
+    struct JourneyLeg
+    {
+        std::string_view bus;
+        std::string_view from_stop;
+        std::string_view to_stop;
+        double departure_time = 0.0;
+        double arrival_time = 0.0;
+    };
+
+    struct Journey
+    {
+        double arrival_time = 0.0;
+        int transfers = 0;
+        std::vector<JourneyLeg> legs;
+    };
+
+    struct JourneyQuery
+    {
+        size_t from_stop_id = 0;
+        size_t to_stop_id = 0;
+        // Минуты от начала суток
+        double departure_time = 0.0;
+    };
+
+    // Поиск поездок по расписаниям алгоритмом RAPTOR: раунд k находит самые ранние прибытия не более
+    // чем с k рейсами, просматривая каждый маршрут один раз от самой ранней отмеченной остановки.
+    // Рейсы одного автобуса идут с одинаковым временем хода, которое считается по дорожным расстояниям
+    // и bus_velocity, поэтому расписание хранится как отправления с начальной остановки и смещения
+    // времени по остановкам, а ближайший рейс ищется двоичным поиском. Некольцевой маршрут — один рейс
+    // туда и обратно; рейс обрывается на первом отрезке без известного расстояния. Учитываются только
+    // автобусы с расписанием. Расписание строится при первом поиске, один раз на версию справочника
+    class JourneyPlanner
+    {
+    public:
+        JourneyPlanner();
+
+        ~JourneyPlanner();
+
+        void SetRoutingSettings(RoutingSettings routing_settings);
+
+        // Парето-оптимальные поездки по времени прибытия и числу пересадок, не больше max_transfers
+        // пересадок, по возрастанию числа пересадок. Последняя прибывает раньше всех. Пусто, если
+        // доехать нельзя. Без настроек маршрутизации бросает std::logic_error
+        std::vector<Journey> FindJourneys(const CatalogueReader& catalogue, const JourneyQuery& query,
+                                          int max_transfers) const;
+
+        // То же для набора запросов; запросы обрабатываются параллельно
+        std::vector<std::vector<Journey>> FindJourneys(const CatalogueReader& catalogue,
+                                                       const std::vector<JourneyQuery>& queries,
+                                                       int max_transfers) const;
+
+        // Сведения о построении расписания
+        IndexBuildStats GetTimetableStats() const;
+
+    private:
+        struct Timetable;
+        struct SearchState;
+
+        std::shared_ptr<const Timetable> GetTimetable(const CatalogueReader& catalogue) const;
+
+        std::shared_ptr<const Timetable> BuildTimetable(const CatalogueReader& catalogue) const;
+
+        std::vector<Journey> Search(const CatalogueReader& catalogue, const Timetable& timetable, SearchState& state,
+                                    const JourneyQuery& query, int max_transfers) const;
+
+        // Настройки меняются и читаются под блокировкой timetable_
+        std::optional<RoutingSettings> routing_settings_;
+        CatalogueIndexCache<Timetable> timetable_;
+        SearchStatePool<SearchState> states_;
+    };
+}
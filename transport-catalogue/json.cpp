@@ -484,4 +484,108 @@ Document Load(std::istream& input) {
 void Print(const Document& doc, std::ostream& output) {
     PrintNode(doc.GetRoot(), PrintContext{output});
 }
+
+StreamReader::StreamReader(std::istream& input)
+    : input_(input) {
+}
+
+bool StreamReader::StartObject() {
+    if ((input_ >> std::ws).peek() != '{') {
+        return false;
+    }
+    input_.get();
+    return true;
+}
+
+std::optional<std::string> StreamReader::NextKey() {
+    char c;
+    if (input_ >> c && c == ',') {
+        input_ >> c;
+    }
+    if (!input_) {
+        throw ParsingError("Dictionary parsing error"s);
+    }
+    if (c == '}') {
+        return std::nullopt;
+    }
+    if (c != '"') {
+        throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
+    }
+
+    std::string key = LoadString(input_).AsString();
+    if (!(input_ >> c) || c != ':') {
+        throw ParsingError(": is expected but '"s + c + "' has been found"s);
+    }
+    return key;
+}
+
+bool StreamReader::StartArray() {
+    if ((input_ >> std::ws).peek() != '[') {
+        return false;
+    }
+    input_.get();
+    return true;
+}
+
+bool StreamReader::NextItem() {
+    char c;
+    if (!(input_ >> c)) {
+        throw ParsingError("Array parsing error"s);
+    }
+    if (c == ']') {
+        return false;
+    }
+    if (c != ',') {
+        input_.putback(c);
+    }
+    return true;
+}
+
+std::string GetCurrentErrorMessage() {
+    try {
+        throw;
+    } catch (const ParsingError& e) {
+        return e.runtime_error::what();
+    } catch (const NodeOutOfRange& e) {
+        return e.out_of_range::what();
+    } catch (const InvalidNodeType& e) {
+        return e.logic_error::what();
+    } catch (const std::exception& e) {
+        return e.what();
+    } catch (...) {
+        return "Unknown error"s;
+    }
+}
+
+Node StreamReader::Load() {
+    return LoadNode(input_);
+}
+
+ArrayPrinter::ArrayPrinter(std::ostream& output)
+    : output_(output) {
+    output_ << "[\n"sv;
+}
+
+void ArrayPrinter::Print(const Node& node) {
+    PrintNode(node, PrintContext{StartRawItem()}.Indented());
+}
+
+std::ostream& ArrayPrinter::StartRawItem() {
+    if (!is_empty_) {
+        output_ << ",\n"sv;
+    }
+    is_empty_ = false;
+    PrintContext{output_}.Indented().PrintIndent();
+    return output_;
+}
+
+std::string PrintArrayItem(const Node& node) {
+    std::ostringstream output;
+    PrintNode(node, PrintContext{output}.Indented());
+    return output.str();
+}
+
+void ArrayPrinter::Close() {
+    output_ << "\n]"sv;
+}
 }
\ No newline at end of file
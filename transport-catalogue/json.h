@@ -1,6 +1,7 @@
 #pragma once
 #include <iostream>
 #include <map>
+#include <optional>
 #include <string>
 #include <vector>
 #include <variant>
@@ -113,6 +114,57 @@ namespace json {
 
     void Print(const Document& doc, std::ostream& output);
 
+    // Текст обрабатываемого исключения. Исключения json наследуют std::exception дважды,
+    // поэтому catch (const std::exception&) их не ловит. Вызывается только внутри catch
+    std::string GetCurrentErrorMessage();
+
+    // Разбор документа по частям: объекты и массивы можно проходить по полям и элементам, загружая
+    // целиком только нужные значения. Разбор такой же, как в Load
+    class StreamReader {
+    public:
+        explicit StreamReader(std::istream& input);
+
+        // Если следующее значение — объект, входит в него и возвращает true, иначе ничего не читает
+        bool StartObject();
+
+        // Ключ следующего поля текущего объекта или nullopt, если объект закончился
+        std::optional<std::string> NextKey();
+
+        // Если следующее значение — массив, входит в него и возвращает true, иначе ничего не читает
+        bool StartArray();
+
+        // true, если в текущем массиве есть ещё элемент; false, если массив закончился
+        bool NextItem();
+
+        // Следующее значение целиком
+        Node Load();
+
+    private:
+        std::istream& input_;
+    };
+
+    // Элемент массива в том виде, в каком его выводит ArrayPrinter, но без отступа перед ним
+    std::string PrintArrayItem(const Node& node);
+
+    // Выводит массив по одному элементу, в том же виде, что и Print для массива целиком.
+    // Закрывающая скобка выводится в Close
+    class ArrayPrinter {
+    public:
+        explicit ArrayPrinter(std::ostream& output);
+
+        void Print(const Node& node);
+
+        // Начинает элемент, текст которого готовит вызывающий так же, как PrintArrayItem:
+        // выводит разделитель и отступ и возвращает поток для текста элемента
+        std::ostream& StartRawItem();
+
+        void Close();
+
+    private:
+        std::ostream& output_;
+        bool is_empty_ = true;
+    };
+
     template <class ValueT>
     bool Node::Is() const noexcept {
         return std::holds_alternative<ValueT>(value_);
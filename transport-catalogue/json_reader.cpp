@@ -3,31 +3,119 @@
 #include "json_builder.h"
 #include "map_renderer.h"
 #include "domain.h"
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <cmath>
 #include <sstream>
+#include <stdexcept>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 using namespace transport;
 
+// Ответ без request_id: объект или текст из кэша ответов, который выводится без повторного разбора
+struct transport::StatResponse
+{
+    StatResponse(json::Node::Object object)
+        : object(std::move(object))
+    {}
+
+    StatResponse(std::shared_ptr<const CachedResponse> cached)
+        : cached(std::move(cached))
+    {}
+
+    json::Node::Object object;
+    std::shared_ptr<const CachedResponse> cached;
+};
+
 namespace
 {
     using namespace std::literals;
 
     const std::string KEY_BASE_R{"base_requests"s};
     const std::string KEY_STAT_R{"stat_requests"s};
+    const std::string KEY_DELTA_R{"delta_requests"s};
     const std::string KEY_RENDER_S{"render_settings"s};
+    const std::string KEY_ROUTING_S{"routing_settings"s};
+    const std::string KEY_BUS_WAIT_TIME{"bus_wait_time"s};
+    const std::string KEY_BUS_VELOCITY{"bus_velocity"s};
+    const std::string KEY_CACHE_S{"cache_settings"s};
+    const std::string KEY_MAX_BYTES{"max_bytes"s};
+    const std::string KEY_EVICTION_POLICY{"eviction_policy"s};
+    const std::string EVICTION_LRU{"lru"s};
+    const std::string EVICTION_FIFO{"fifo"s};
     const std::string KEY_STOP{"Stop"s};
     const std::string KEY_BUS{"Bus"s};
+    const std::string KEY_DISTANCE{"Distance"s};
+    const std::string KEY_REMOVE{"remove"s};
+    const std::string KEY_FROM{"from"s};
+    const std::string KEY_TO{"to"s};
+    const std::string KEY_DISTANCE_VALUE{"distance"s};
     const std::string KEY_TYPE{"type"s};
     const std::string KEY_NAME{"name"s};
     const std::string KEY_MAP_REQ{"Map"s};
+    const std::string KEY_TOP_BUSES_REQ{"TopBuses"s};
+    const std::string KEY_TOP_STOPS_REQ{"TopStops"s};
+    const std::string KEY_NETWORK_STATS_REQ{"NetworkStats"s};
+    const std::string KEY_DIRECT_BUSES_REQ{"DirectBuses"s};
+    const std::string KEY_CO_SERVED_STOPS_REQ{"CoServedStops"s};
+    const std::string KEY_REACHABLE_STOPS_REQ{"ReachableStops"s};
+    const std::string KEY_REACHABILITY_COVERAGE_REQ{"ReachabilityCoverage"s};
+    const std::string KEY_MAX_TRANSFERS{"max_transfers"s};
+    const std::string KEY_NAMES{"names"s};
+    const std::string KEY_RESULTS{"results"s};
+    const std::string KEY_TRANSFERS{"transfers"s};
+    const std::string KEY_REACHABLE_STOP_COUNT{"reachable_stop_count"s};
+    const std::string KEY_ISOCHRONE_REQ{"Isochrone"s};
+    const std::string KEY_TIME_LIMIT{"time_limit"s};
+    const std::string KEY_TIME{"time"s};
+    const std::string KEY_TRAVEL_TIME_MATRIX_REQ{"TravelTimeMatrix"s};
+    const std::string KEY_SOURCES{"sources"s};
+    const std::string KEY_TARGETS{"targets"s};
+    const std::string KEY_TIMES{"times"s};
+    const std::string KEY_JOURNEY_REQ{"Journey"s};
+    const std::string KEY_QUERIES{"queries"s};
+    const std::string KEY_JOURNEYS{"journeys"s};
+    const std::string KEY_LEGS{"legs"s};
+    const std::string KEY_LEG_BUS{"bus"s};
+    const std::string KEY_DEPARTURE_TIME{"departure_time"s};
+    const std::string KEY_ARRIVAL_TIME{"arrival_time"s};
+    const int DEFAULT_MAX_TRANSFERS = 4;
+    const std::string KEY_BY{"by"s};
+    const std::string KEY_COUNT{"count"s};
+    const std::string KEY_BUS_COUNT{"bus_count"s};
+    const std::string KEY_SERVED_STOP_COUNT{"served_stop_count"s};
+    const std::string KEY_TOTAL_R_LENGTH{"total_route_length"s};
+    const std::string KEY_TOTAL_STOP_COUNT{"total_stop_count"s};
+    const std::string UNKNOWN_RANKING{"unknown ranking"s};
+    const int DEFAULT_TOP_COUNT = 10;
     const std::string KEY_MAP_RESP{"map"s};
+    const std::string KEY_FORMAT{"format"s};
+    const std::string FORMAT_TILE{"tile"s};
     const std::string KEY_LATITUDE{"latitude"s};
     const std::string KEY_LONGITUDE{"longitude"s};
     const std::string KEY_R_DISTANCES{"road_distances"s};
     const std::string KEY_ROUNDTRIP{"is_roundtrip"s};
+    const std::string KEY_TIMETABLE{"timetable"s};
+    const std::string KEY_DEPARTURES{"departures"s};
+    const std::string KEY_FIRST_DEPARTURE{"first_departure"s};
+    const std::string KEY_LAST_DEPARTURE{"last_departure"s};
+    const std::string KEY_HEADWAY{"headway"s};
+    // Около рейса каждые 10 секунд круглые сутки
+    const int MAX_TIMETABLE_TRIPS = 10000;
     const std::string KEY_ID{"id"s};
     const std::string KEY_CURVATURE{"curvature"s};
     const std::string KEY_REQUEST_ID{"request_id"s};
@@ -50,6 +138,10 @@ namespace
     const std::string KEY_STOP_LABEL_OFFSET{"stop_label_offset"s};
     const std::string KEY_UNDERL_COLOR{"underlayer_color"s};
     const std::string KEY_COLOR_PALETTE{"color_palette"s};
+    const std::string KEY_COMPACT_SVG{"compact_svg"s};
+    const std::string KEY_COORD_PRECISION{"coordinate_precision"s};
+    // Больше знаков double всё равно не хранит
+    const int MAX_COORD_PRECISION = 15;
 
     svg::Color GetColor(const json::Node& color_node)
     {
@@ -72,45 +164,222 @@ namespace
         }
     }
 
-    void SendBaseRequests(transport::RequestHandler& request_handler, const json::Node& requests)
+    // Необязательное расписание маршрута, минуты от начала суток: явный список "departures" или
+    // интервал движения "headway" от "first_departure" до "last_departure" включительно
+    std::vector<double> GetDepartures(const json::Node& bus_request)
+    {
+        std::vector<double> departures;
+
+        if (!bus_request.Contains(KEY_TIMETABLE))
+        {
+            return departures;
+        }
+
+        const auto& timetable = bus_request.At(KEY_TIMETABLE);
+
+        if (timetable.Contains(KEY_DEPARTURES))
+        {
+            for (const auto& departure : timetable.At(KEY_DEPARTURES).AsArray())
+            {
+                departures.push_back(departure.AsDouble());
+            }
+            return departures;
+        }
+
+        const double first = timetable.At(KEY_FIRST_DEPARTURE).AsDouble();
+        const double last = timetable.At(KEY_LAST_DEPARTURE).AsDouble();
+        const double headway = timetable.At(KEY_HEADWAY).AsDouble();
+
+        if (headway <= 0.0)
+        {
+            throw std::invalid_argument("Headway must be positive"s);
+        }
+        // Иначе крошечный интервал или бесконечная граница развернулись бы в неограниченный список рейсов
+        if (!(std::floor((last - first) / headway) < MAX_TIMETABLE_TRIPS))
+        {
+            throw std::invalid_argument("Timetable must have at most "s + std::to_string(MAX_TIMETABLE_TRIPS)
+                                        + " trips"s);
+        }
+
+        for (size_t i = 0; first + i * headway <= last; ++i)
+        {
+            departures.push_back(first + i * headway);
+        }
+        return departures;
+    }
+
+    // Строки запроса должны жить до UpdateCatalogue: обработчик хранит ссылки на них
+    void SendBaseRequest(transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const std::string& request_key = request.At(KEY_TYPE).AsString();
+
+        if (request_key == KEY_STOP)
+        {
+            std::map<std::string_view, int> road_distances;
+
+            for (const auto& [stop_name, distance] : request.At(KEY_R_DISTANCES).AsObject())
+            {
+                road_distances.emplace(stop_name, distance.AsInt());
+            }
+
+            request_handler.AddStopRequest(
+                    request.At(KEY_NAME).AsString(),
+                    {request.At(KEY_LATITUDE).AsDouble(), request.At(KEY_LONGITUDE).AsDouble()},
+                    road_distances);
+        }
+        else if (request_key == KEY_BUS)
+        {
+            std::vector<std::string_view> stops;
+            const auto& stops_array = request.At(KEY_STOPS).AsArray();
+            stops.reserve(stops_array.size());
+
+            for (const auto& stop_name : stops_array)
+            {
+                stops.push_back(stop_name.AsString());
+            }
+
+            request_handler.AddBusRequest(
+                    request.At(KEY_NAME).AsString(),
+                    stops,
+                    request.At(KEY_ROUNDTRIP).AsBool(),
+                    GetDepartures(request));
+        }
+    }
+
+    // Очередь base_requests от разбирающего потока к строящему справочник. Запросы передаются
+    // пачками, чтобы не синхронизироваться на каждом
+    class BaseRequestQueue
+    {
+    public:
+        void Push(std::vector<json::Node> requests)
+        {
+            {
+                std::lock_guard guard(mutex_);
+                batches_.push_back(std::move(requests));
+            }
+            ready_.notify_one();
+        }
+
+        void Close()
+        {
+            {
+                std::lock_guard guard(mutex_);
+                is_closed_ = true;
+            }
+            ready_.notify_one();
+        }
+
+        // Следующая пачка или nullopt, когда очередь закрыта и пуста
+        std::optional<std::vector<json::Node>> Pop()
+        {
+            std::unique_lock lock(mutex_);
+            ready_.wait(lock, [this] {
+                return !batches_.empty() || is_closed_;
+            });
+
+            if (batches_.empty())
+            {
+                return std::nullopt;
+            }
+            auto batch = std::move(batches_.front());
+            batches_.pop_front();
+            return batch;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::deque<std::vector<json::Node>> batches_;
+        bool is_closed_ = false;
+    };
+
+    const size_t BASE_REQUEST_BATCH_SIZE = 256;
+
+    // Принимает запросы из очереди по мере разбора и строит справочник, когда очередь закрыта
+    void BuildCatalogue(transport::RequestHandler& request_handler, BaseRequestQueue& queue)
+    {
+        std::deque<json::Node> requests;
+
+        while (auto batch = queue.Pop())
+        {
+            for (auto& request : *batch)
+            {
+                SendBaseRequest(request_handler, requests.emplace_back(std::move(request)));
+            }
+        }
+
+        // Пустой base_requests ничего не меняет, поэтому допустим и для справочника только для чтения
+        if (!requests.empty())
+        {
+            request_handler.UpdateCatalogue();
+        }
+    }
+
+    // Элемент с "remove": true удаляет объект, остальные добавляют или заменяют его.
+    // Возвращает ошибочные элементы, из-за которых изменения не применены
+    std::vector<std::string> SendDeltaRequests(transport::RequestHandler& request_handler, const json::Node& requests)
     {
+        // Как и пустой base_requests, пустой delta_requests ничего не меняет
+        if (requests.AsArray().empty())
+        {
+            return {};
+        }
+
+        transport::CatalogueDelta delta;
+
         for (const auto& request : requests.AsArray())
         {
             const std::string& request_key = request.At(KEY_TYPE).AsString();
+            const bool is_remove = request.Contains(KEY_REMOVE) && request.At(KEY_REMOVE).AsBool();
 
             if (request_key == KEY_STOP)
             {
-                std::map<std::string_view, int> road_distances;
+                auto& stop_change = delta.stops.emplace_back();
+                stop_change.name = request.At(KEY_NAME).AsString();
 
-                for (const auto& [stop_name, distance] : request.At(KEY_R_DISTANCES).AsObject())
+                if (!is_remove)
                 {
-                    road_distances.emplace(stop_name, distance.AsInt());
+                    stop_change.coordinates = {request.At(KEY_LATITUDE).AsDouble(), request.At(KEY_LONGITUDE).AsDouble()};
+
+                    if (request.Contains(KEY_R_DISTANCES))
+                    {
+                        for (const auto& [stop_name, distance] : request.At(KEY_R_DISTANCES).AsObject())
+                        {
+                            stop_change.road_distances.emplace(stop_name, distance.AsInt());
+                        }
+                    }
                 }
+            }
+            else if (request_key == KEY_DISTANCE)
+            {
+                auto& distance_change = delta.distances.emplace_back();
+                distance_change.from = request.At(KEY_FROM).AsString();
+                distance_change.to = request.At(KEY_TO).AsString();
 
-                request_handler.AddStopRequest(
-                        request.At(KEY_NAME).AsString(),
-                        {request.At(KEY_LATITUDE).AsDouble(), request.At(KEY_LONGITUDE).AsDouble()},
-                        road_distances);
+                if (!is_remove)
+                {
+                    distance_change.distance = request.At(KEY_DISTANCE_VALUE).AsInt();
+                }
             }
             else if (request_key == KEY_BUS)
             {
-                std::vector<std::string_view> stops;
-                const auto& stops_array = request.At(KEY_STOPS).AsArray();
-                stops.reserve(stops_array.size());
+                auto& bus_change = delta.buses.emplace_back();
+                bus_change.name = request.At(KEY_NAME).AsString();
 
-                for (const auto& stop_name : stops_array)
+                if (!is_remove)
                 {
-                    stops.push_back(stop_name.AsString());
+                    auto& stops = bus_change.stops.emplace();
+                    for (const auto& stop_name : request.At(KEY_STOPS).AsArray())
+                    {
+                        stops.push_back(stop_name.AsString());
+                    }
+                    bus_change.is_roundtrip = request.At(KEY_ROUNDTRIP).AsBool();
+                    bus_change.departures = GetDepartures(request);
                 }
-
-                request_handler.AddBusRequest(
-                        request.At(KEY_NAME).AsString(),
-                        stops,
-                        request.At(KEY_ROUNDTRIP).AsBool());
             }
         }
 
-        request_handler.UpdateCatalogue();
+        return request_handler.ApplyDelta(delta).errors;
     }
 
     void SendRenderSettings(transport::RequestHandler& request_handler, const json::Node& requests)
@@ -172,10 +441,71 @@ namespace
                 settings.color_palette.push_back(GetColor(color_node));
             }
         }
+        if (requests.Contains(KEY_COMPACT_SVG))
+        {
+            settings.compact_svg = requests.At(KEY_COMPACT_SVG).AsBool();
+        }
+        if (requests.Contains(KEY_COORD_PRECISION))
+        {
+            const int precision = requests.At(KEY_COORD_PRECISION).AsInt();
+            if (precision < 0 || precision > MAX_COORD_PRECISION)
+            {
+                throw std::invalid_argument("Coordinate precision must be in 0.."s + std::to_string(MAX_COORD_PRECISION));
+            }
+            settings.coordinate_precision = precision;
+        }
 
         request_handler.SetRendererSettings(settings);
     }
 
+    void SendRoutingSettings(transport::RequestHandler& request_handler, const json::Node& requests)
+    {
+        transport::RoutingSettings settings{};
+        settings.bus_wait_time = requests.At(KEY_BUS_WAIT_TIME).AsInt();
+        settings.bus_velocity = requests.At(KEY_BUS_VELOCITY).AsDouble();
+        // Отрицательные веса рёбер ломают поиск кратчайших путей
+        if (settings.bus_wait_time < 0)
+        {
+            throw std::invalid_argument("Bus wait time must not be negative"s);
+        }
+        if (!(settings.bus_velocity > 0.0))
+        {
+            throw std::invalid_argument("Bus velocity must be positive"s);
+        }
+        request_handler.SetRoutingSettings(settings);
+    }
+
+    void SendCacheSettings(transport::RequestHandler& request_handler, const json::Node& requests)
+    {
+        transport::ResponseCacheSettings settings{};
+        if (requests.Contains(KEY_MAX_BYTES))
+        {
+            const int max_bytes = requests.At(KEY_MAX_BYTES).AsInt();
+            if (max_bytes < 0)
+            {
+                throw std::invalid_argument("Cache size must not be negative"s);
+            }
+            settings.max_bytes = size_t(max_bytes);
+        }
+        if (requests.Contains(KEY_EVICTION_POLICY))
+        {
+            const std::string& policy = requests.At(KEY_EVICTION_POLICY).AsString();
+            if (policy == EVICTION_LRU)
+            {
+                settings.eviction_policy = transport::EvictionPolicy::LRU;
+            }
+            else if (policy == EVICTION_FIFO)
+            {
+                settings.eviction_policy = transport::EvictionPolicy::FIFO;
+            }
+            else
+            {
+                throw std::invalid_argument("Unknown eviction policy "s + policy);
+            }
+        }
+        request_handler.SetResponseCacheSettings(settings);
+    }
+
     json::Node::Object SendStopStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
     {
         auto object_builder = json::Builder{};
@@ -231,82 +561,1055 @@ namespace
         return object_builder.Build().AsObject();
     }
 
-    json::Node::Object SendMapStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    size_t GetTopCount(const json::Node& request, size_t size)
+    {
+        const int count = request.Contains(KEY_COUNT) ? request.At(KEY_COUNT).AsInt() : DEFAULT_TOP_COUNT;
+        return std::min(size_t(std::max(count, 0)), size);
+    }
+
+    // json::Node хранит только int, поэтому большие суммы выводятся как double
+    json::Node::Value MakeCountValue(int64_t value)
+    {
+        if (value <= INT_MAX)
+        {
+            return int(value);
+        }
+        return double(value);
+    }
+
+    // "by": "route_length" (по умолчанию) или "curvature"
+    json::Node::Object SendTopBusesStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const std::string& ranking = request.Contains(KEY_BY) ? request.At(KEY_BY).AsString() : KEY_R_LENGTH;
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
+
+        if (ranking != KEY_R_LENGTH && ranking != KEY_CURVATURE)
+        {
+            object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+            object_builder.Key(KEY_ERROR).Value(UNKNOWN_RANKING);
+            object_builder.EndObject();
+            return object_builder.Build().AsObject();
+        }
+
+        const auto& stats = request_handler.GetNetworkStats();
+        const auto& order = ranking == KEY_R_LENGTH ? stats.buses_by_length : stats.buses_by_curvature;
+        const size_t count = GetTopCount(request, order.size());
+
+        auto array_builder = json::Builder{};
+        array_builder.StartArray();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const BusInfo& bus_info = stats.buses[order[i]];
+            array_builder.StartObject()
+                    .Key(KEY_NAME).Value(std::string{bus_info.name})
+                    .Key(KEY_R_LENGTH).Value(bus_info.route_length)
+                    .Key(KEY_CURVATURE).Value(bus_info.curvature)
+                    .Key(KEY_STOP_COUNT).Value(bus_info.stops_on_route)
+                    .Key(KEY_U_STOP_COUNT).Value(bus_info.unique_stops)
+                    .EndObject();
+        }
+
+        array_builder.EndArray();
+
+        object_builder.Key(KEY_BUSES).Value(array_builder.Build().AsArray());
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
+        return object_builder.Build().AsObject();
+    }
+
+    json::Node::Object SendTopStopsStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const auto& stops = request_handler.GetNetworkStats().stops_by_bus_count;
+        const size_t count = GetTopCount(request, stops.size());
+
+        auto array_builder = json::Builder{};
+        array_builder.StartArray();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            array_builder.StartObject()
+                    .Key(KEY_NAME).Value(std::string{stops[i].name})
+                    .Key(KEY_BUS_COUNT).Value(int(stops[i].bus_count))
+                    .EndObject();
+        }
+
+        array_builder.EndArray();
+
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
+        object_builder.Key(KEY_STOPS).Value(array_builder.Build().AsArray());
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
+        return object_builder.Build().AsObject();
+    }
+
+    json::Node::Object SendNetworkStatsStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
     {
-        std::ostringstream out;
-        request_handler.RenderMap().Render(out);
+        const auto& stats = request_handler.GetNetworkStats();
 
         auto object_builder = json::Builder{};
         object_builder.StartObject();
-        object_builder.Key(KEY_MAP_RESP).Value(out.str());
+        object_builder.Key(KEY_BUS_COUNT).Value(int(stats.bus_count));
+        object_builder.Key(KEY_STOP_COUNT).Value(int(stats.stop_count));
+        object_builder.Key(KEY_SERVED_STOP_COUNT).Value(int(stats.stops_by_bus_count.size()));
+        object_builder.Key(KEY_TOTAL_R_LENGTH).Value(MakeCountValue(stats.total_route_length));
+        object_builder.Key(KEY_TOTAL_STOP_COUNT).Value(MakeCountValue(stats.total_stops_on_route));
         object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
         object_builder.EndObject();
+        return object_builder.Build().AsObject();
+    }
 
+    // Ответ со списком названий под ключом key или "not found", если названий нет
+    json::Node::Object MakeNamesResponse(const std::optional<std::vector<std::string_view>>& names,
+                                         const std::string& key, const json::Node& request)
+    {
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
+
+        if (names)
+        {
+            json::Node::Array names_array;
+            names_array.reserve(names->size());
+
+            for (const auto name : *names)
+            {
+                names_array.emplace_back(std::string{name});
+            }
+
+            object_builder.Key(key).Value(std::move(names_array));
+        }
+        else
+        {
+            object_builder.Key(KEY_ERROR).Value(NOT_FOUND);
+        }
+
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
         return object_builder.Build().AsObject();
     }
 
-    json::Node::Array SendStatRequests(const transport::RequestHandler& request_handler, const json::Node& requests)
+    json::Node::Object SendDirectBusesStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const auto buses = request_handler.GetDirectBuses(request.At(KEY_FROM).AsString(), request.At(KEY_TO).AsString());
+        return MakeNamesResponse(buses, KEY_BUSES, request);
+    }
+
+    json::Node::Object SendCoServedStopsStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const auto stops = request_handler.GetCoServedStops(request.At(KEY_NAME).AsString());
+        return MakeNamesResponse(stops, KEY_STOPS, request);
+    }
+
+    std::vector<std::string_view> GetNames(const json::Node& names_node)
+    {
+        std::vector<std::string_view> names;
+        names.reserve(names_node.AsArray().size());
+
+        for (const auto& name : names_node.AsArray())
+        {
+            names.push_back(name.AsString());
+        }
+
+        return names;
+    }
+
+    json::Node MakeReachableStopsNode(const std::vector<std::pair<std::string_view, int>>& stops)
     {
         auto array_builder = json::Builder{};
         array_builder.StartArray();
 
-        try
+        for (const auto& [name, transfers] : stops)
         {
-            for (const auto& request: requests.AsArray())
-            {
-                const std::string& request_key = request.At(KEY_TYPE).AsString();
+            array_builder.StartObject()
+                    .Key(KEY_NAME).Value(std::string{name})
+                    .Key(KEY_TRANSFERS).Value(transfers)
+                    .EndObject();
+        }
 
-                if (request_key == KEY_STOP)
-                {
-                    array_builder.Value(SendStopStatRequest(request_handler, request));
-                }
-                else if (request_key == KEY_BUS)
+        array_builder.EndArray();
+        return array_builder.Build();
+    }
+
+    // Для одной остановки — "name", для пакета — "names" и ответ по каждой остановке в "results"
+    json::Node::Object SendReachableStopsStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const int max_transfers = request.At(KEY_MAX_TRANSFERS).AsInt();
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
+
+        if (request.Contains(KEY_NAMES))
+        {
+            const auto names = GetNames(request.At(KEY_NAMES));
+            const auto reachable = request_handler.GetReachableStops(names, max_transfers);
+            auto array_builder = json::Builder{};
+            array_builder.StartArray();
+
+            for (size_t i = 0; i < names.size(); ++i)
+            {
+                array_builder.StartObject().Key(KEY_NAME).Value(std::string{names[i]});
+                if (reachable[i])
                 {
-                    array_builder.Value(SendBusStatRequest(request_handler, request));
+                    array_builder.Key(KEY_STOPS).Value(MakeReachableStopsNode(*reachable[i]).AsArray());
                 }
-                else if (request_key == KEY_MAP_REQ)
+                else
                 {
-                    array_builder.Value(SendMapStatRequest(request_handler, request));
+                    array_builder.Key(KEY_ERROR).Value(NOT_FOUND);
                 }
+                array_builder.EndObject();
+            }
+
+            array_builder.EndArray();
+            object_builder.Key(KEY_RESULTS).Value(array_builder.Build().AsArray());
+        }
+        else
+        {
+            const auto reachable = request_handler.GetReachableStops(request.At(KEY_NAME).AsString(), max_transfers);
+            if (reachable)
+            {
+                object_builder.Key(KEY_STOPS).Value(MakeReachableStopsNode(*reachable).AsArray());
+            }
+            else
+            {
+                object_builder.Key(KEY_ERROR).Value(NOT_FOUND);
             }
         }
-        catch (const json::JsonException& e)
-        {}
 
-        array_builder.EndArray();
-        return array_builder.Build().AsArray();
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
+        return object_builder.Build().AsObject();
     }
-}
 
-JsonReader::JsonReader(RequestHandler& request_handler)
-    : request_handler_(request_handler)
-{
-    response_builder_.StartArray();
-}
+    json::Node::Object SendReachabilityCoverageStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const auto coverage = request_handler.GetReachabilityCoverage(request.At(KEY_MAX_TRANSFERS).AsInt());
 
-void JsonReader::SendJsonRequests(std::istream& input)
-{
-    const auto json_requests = json::Load(input).GetRoot();
+        auto array_builder = json::Builder{};
+        array_builder.StartArray();
 
-    if (json_requests.Contains(KEY_BASE_R))
-    {
-        SendBaseRequests(request_handler_, json_requests.At(KEY_BASE_R));
-    }
+        for (const auto& [name, count] : coverage)
+        {
+            array_builder.StartObject()
+                    .Key(KEY_NAME).Value(std::string{name})
+                    .Key(KEY_REACHABLE_STOP_COUNT).Value(int(count))
+                    .EndObject();
+        }
 
-    if (json_requests.Contains(KEY_RENDER_S))
-    {
-        SendRenderSettings(request_handler_, json_requests.At(KEY_RENDER_S));
+        array_builder.EndArray();
+
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
+        object_builder.Key(KEY_STOPS).Value(array_builder.Build().AsArray());
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
+        return object_builder.Build().AsObject();
     }
 
-    if (json_requests.Contains(KEY_STAT_R))
+    json::Node::Object SendIsochroneStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
     {
-        response_builder_.Merge(SendStatRequests(request_handler_, json_requests.At(KEY_STAT_R)));
-    }
-}
+        const auto stops = request_handler.GetIsochrone(request.At(KEY_FROM).AsString(), request.At(KEY_TIME_LIMIT).AsDouble());
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
 
-void JsonReader::OutputJsonResponse(std::ostream& out)
-{
-    response_builder_.EndArray();
-    json::Print(json::Document(response_builder_.Build()), out);
+        if (stops)
+        {
+            auto array_builder = json::Builder{};
+            array_builder.StartArray();
+
+            for (const auto& [name, time] : *stops)
+            {
+                array_builder.StartObject()
+                        .Key(KEY_NAME).Value(std::string{name})
+                        .Key(KEY_TIME).Value(time)
+                        .EndObject();
+            }
+
+            array_builder.EndArray();
+            object_builder.Key(KEY_STOPS).Value(array_builder.Build().AsArray());
+        }
+        else
+        {
+            object_builder.Key(KEY_ERROR).Value(NOT_FOUND);
+        }
+
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
+        return object_builder.Build().AsObject();
+    }
+
+    // Строки матрицы переводятся в JSON прямо в рабочих потоках, по мере готовности; недостижимые
+    // остановки — null
+    json::Node::Object SendTravelTimeMatrixStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const auto sources = GetNames(request.At(KEY_SOURCES));
+        const auto targets = GetNames(request.At(KEY_TARGETS));
+        json::Node::Array rows(sources.size());
+
+        const bool found = request_handler.ComputeTravelTimes(sources, targets, [&rows](size_t i, std::vector<double> times) {
+            json::Node::Array row;
+            row.reserve(times.size());
+
+            for (const double time : times)
+            {
+                if (std::isinf(time))
+                {
+                    row.emplace_back(nullptr);
+                }
+                else
+                {
+                    row.emplace_back(time);
+                }
+            }
+
+            rows[i] = std::move(row);
+        });
+
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
+
+        if (found)
+        {
+            object_builder.Key(KEY_TIMES).Value(std::move(rows));
+        }
+        else
+        {
+            object_builder.Key(KEY_ERROR).Value(NOT_FOUND);
+        }
+
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
+        return object_builder.Build().AsObject();
+    }
+
+    json::Node MakeJourneysNode(const std::vector<transport::Journey>& journeys)
+    {
+        auto array_builder = json::Builder{};
+        array_builder.StartArray();
+
+        for (const auto& journey : journeys)
+        {
+            auto legs_builder = json::Builder{};
+            legs_builder.StartArray();
+
+            for (const auto& leg : journey.legs)
+            {
+                legs_builder.StartObject()
+                        .Key(KEY_LEG_BUS).Value(std::string{leg.bus})
+                        .Key(KEY_FROM).Value(std::string{leg.from_stop})
+                        .Key(KEY_TO).Value(std::string{leg.to_stop})
+                        .Key(KEY_DEPARTURE_TIME).Value(leg.departure_time)
+                        .Key(KEY_ARRIVAL_TIME).Value(leg.arrival_time)
+                        .EndObject();
+            }
+
+            legs_builder.EndArray();
+            array_builder.StartObject()
+                    .Key(KEY_ARRIVAL_TIME).Value(journey.arrival_time)
+                    .Key(KEY_TRANSFERS).Value(journey.transfers)
+                    .Key(KEY_LEGS).Value(legs_builder.Build().AsArray())
+                    .EndObject();
+        }
+
+        array_builder.EndArray();
+        return array_builder.Build();
+    }
+
+    transport::RequestHandler::JourneyRequest GetJourneyRequest(const json::Node& request)
+    {
+        return {request.At(KEY_FROM).AsString(), request.At(KEY_TO).AsString(), request.At(KEY_DEPARTURE_TIME).AsDouble()};
+    }
+
+    // Для одной поездки — "from", "to" и "departure_time", для пакета — "queries" с такими же объектами
+    // и ответ по каждому в "results". Поездки — Парето-фронт по времени прибытия и числу пересадок
+    json::Node::Object SendJourneyStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        const int max_transfers = request.Contains(KEY_MAX_TRANSFERS) ? request.At(KEY_MAX_TRANSFERS).AsInt()
+                                                                      : DEFAULT_MAX_TRANSFERS;
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
+
+        if (request.Contains(KEY_QUERIES))
+        {
+            std::vector<transport::RequestHandler::JourneyRequest> journey_requests;
+            for (const auto& query : request.At(KEY_QUERIES).AsArray())
+            {
+                journey_requests.push_back(GetJourneyRequest(query));
+            }
+
+            const auto results = request_handler.GetJourneys(journey_requests, max_transfers);
+            auto array_builder = json::Builder{};
+            array_builder.StartArray();
+
+            for (const auto& journeys : results)
+            {
+                array_builder.StartObject();
+                if (journeys)
+                {
+                    array_builder.Key(KEY_JOURNEYS).Value(MakeJourneysNode(*journeys).AsArray());
+                }
+                else
+                {
+                    array_builder.Key(KEY_ERROR).Value(NOT_FOUND);
+                }
+                array_builder.EndObject();
+            }
+
+            array_builder.EndArray();
+            object_builder.Key(KEY_RESULTS).Value(array_builder.Build().AsArray());
+        }
+        else
+        {
+            const auto journeys = request_handler.GetJourneys(GetJourneyRequest(request), max_transfers);
+            if (journeys)
+            {
+                object_builder.Key(KEY_JOURNEYS).Value(MakeJourneysNode(*journeys).AsArray());
+            }
+            else
+            {
+                object_builder.Key(KEY_ERROR).Value(NOT_FOUND);
+            }
+        }
+
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
+        return object_builder.Build().AsObject();
+    }
+
+    // Бинарный тайл передаётся в JSON-строке в кодировке base64
+    std::string EncodeBase64(const std::string& data)
+    {
+        static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string result;
+        result.reserve((data.size() + 2) / 3 * 4);
+
+        for (size_t i = 0; i < data.size(); i += 3)
+        {
+            uint32_t chunk = uint32_t(uint8_t(data[i])) << 16;
+            if (i + 1 < data.size())
+            {
+                chunk |= uint32_t(uint8_t(data[i + 1])) << 8;
+            }
+            if (i + 2 < data.size())
+            {
+                chunk |= uint32_t(uint8_t(data[i + 2]));
+            }
+
+            result.push_back(ALPHABET[(chunk >> 18) & 0x3F]);
+            result.push_back(ALPHABET[(chunk >> 12) & 0x3F]);
+            result.push_back(i + 1 < data.size() ? ALPHABET[(chunk >> 6) & 0x3F] : '=');
+            result.push_back(i + 2 < data.size() ? ALPHABET[chunk & 0x3F] : '=');
+        }
+
+        return result;
+    }
+
+    json::Node::Object SendMapStatRequest(const transport::RequestHandler& request_handler, const json::Node& request)
+    {
+        std::string map;
+
+        if (request.Contains(KEY_FORMAT) && request.At(KEY_FORMAT).AsString() == FORMAT_TILE)
+        {
+            map = EncodeBase64(request_handler.RenderMapTile());
+        }
+        else
+        {
+            std::ostringstream out;
+            request_handler.RenderMap(out);
+            map = out.str();
+        }
+
+        auto object_builder = json::Builder{};
+        object_builder.StartObject();
+        object_builder.Key(KEY_MAP_RESP).Value(std::move(map));
+        object_builder.Key(KEY_REQUEST_ID).Value(request.At(KEY_ID).AsInt());
+        object_builder.EndObject();
+
+        return object_builder.Build().AsObject();
+    }
+
+    using StatRequestSender = json::Node::Object (*)(const transport::RequestHandler&, const json::Node&);
+
+    // Параметры запроса без id, выведенные в JSON, где поля объекта всегда идут по порядку.
+    // Одинаковые запросы с разными id получают один и тот же ключ
+    std::string MakeRequestKey(const json::Node& request)
+    {
+        json::Node::Object parameters = request.AsObject();
+        parameters.erase(KEY_ID);
+        std::ostringstream key;
+        json::Print(json::Document(std::move(parameters)), key);
+        return key.str();
+    }
+
+    // Текст ответа как элемента массива без значения request_id. Переводы строк внутри строк экранируются,
+    // поэтому поле request_id верхнего уровня однозначно находится по переводу строки и отступу полей
+    transport::CachedResponse MakeCachedResponse(json::Node::Object response)
+    {
+        response[KEY_REQUEST_ID] = 0;
+        transport::CachedResponse cached{json::PrintArrayItem(json::Node(std::move(response)))};
+
+        // Текст начинается с "{\n" и отступа первого поля
+        const size_t field_indent = cached.text.find_first_not_of(' ', 2) - 2;
+        const std::string field_start = "\n"s + std::string(field_indent, ' ') + '"' + KEY_REQUEST_ID + "\": "s;
+        cached.request_id_offset = cached.text.find(field_start) + field_start.size();
+        cached.text.erase(cached.request_id_offset, 1);
+        return cached;
+    }
+
+    // Ответ хранится в кэше обработчика текстом и при попадании выводится как есть
+    StatResponse SendCachedStatRequest(const transport::RequestHandler& request_handler, const json::Node& request,
+                                       const std::string& request_key, StatRequestSender send)
+    {
+        if (auto cached = request_handler.FindCachedResponse(request_key))
+        {
+            return cached;
+        }
+
+        json::Node::Object response = send(request_handler, request);
+        request_handler.CacheResponse(request_key, MakeCachedResponse(response));
+        response.erase(KEY_REQUEST_ID);
+        return response;
+    }
+
+    // Ответ на один запрос или nullopt для запроса неизвестного типа
+    std::optional<StatResponse> SendStatRequest(const transport::RequestHandler& request_handler,
+                                                const json::Node& request, const std::string& request_key)
+    {
+        const std::string& request_type = request.At(KEY_TYPE).AsString();
+
+        if (request_type == KEY_STOP)
+        {
+            return SendStopStatRequest(request_handler, request);
+        }
+        else if (request_type == KEY_BUS)
+        {
+            return SendBusStatRequest(request_handler, request);
+        }
+        else if (request_type == KEY_MAP_REQ)
+        {
+            return SendCachedStatRequest(request_handler, request, request_key, SendMapStatRequest);
+        }
+        else if (request_type == KEY_TOP_BUSES_REQ)
+        {
+            return SendTopBusesStatRequest(request_handler, request);
+        }
+        else if (request_type == KEY_TOP_STOPS_REQ)
+        {
+            return SendTopStopsStatRequest(request_handler, request);
+        }
+        else if (request_type == KEY_NETWORK_STATS_REQ)
+        {
+            return SendNetworkStatsStatRequest(request_handler, request);
+        }
+        else if (request_type == KEY_DIRECT_BUSES_REQ)
+        {
+            return SendDirectBusesStatRequest(request_handler, request);
+        }
+        else if (request_type == KEY_CO_SERVED_STOPS_REQ)
+        {
+            return SendCoServedStopsStatRequest(request_handler, request);
+        }
+        else if (request_type == KEY_REACHABLE_STOPS_REQ)
+        {
+            return SendCachedStatRequest(request_handler, request, request_key, SendReachableStopsStatRequest);
+        }
+        else if (request_type == KEY_REACHABILITY_COVERAGE_REQ)
+        {
+            return SendCachedStatRequest(request_handler, request, request_key, SendReachabilityCoverageStatRequest);
+        }
+        else if (request_type == KEY_ISOCHRONE_REQ)
+        {
+            return SendCachedStatRequest(request_handler, request, request_key, SendIsochroneStatRequest);
+        }
+        else if (request_type == KEY_JOURNEY_REQ)
+        {
+            return SendCachedStatRequest(request_handler, request, request_key, SendJourneyStatRequest);
+        }
+        else if (request_type == KEY_TRAVEL_TIME_MATRIX_REQ)
+        {
+            return SendCachedStatRequest(request_handler, request, request_key, SendTravelTimeMatrixStatRequest);
+        }
+
+        return std::nullopt;
+    }
+
+    // Примерная стоимость запроса в условных единицах, где поиск по названию стоит 1
+    size_t EstimateCost(const json::Node& request)
+    {
+        if (!request.Contains(KEY_TYPE) || !request.At(KEY_TYPE).IsString())
+        {
+            return 1;
+        }
+
+        auto count_of = [&request](const std::string& key) {
+            return request.Contains(key) && request.At(key).IsArray() ? request.At(key).AsArray().size() : size_t(1);
+        };
+
+        const std::string& request_type = request.At(KEY_TYPE).AsString();
+        if (request_type == KEY_MAP_REQ || request_type == KEY_REACHABILITY_COVERAGE_REQ)
+        {
+            return 100000;
+        }
+        else if (request_type == KEY_TRAVEL_TIME_MATRIX_REQ)
+        {
+            return 1000 * count_of(KEY_SOURCES);
+        }
+        else if (request_type == KEY_ISOCHRONE_REQ)
+        {
+            return 1000;
+        }
+        else if (request_type == KEY_JOURNEY_REQ)
+        {
+            return 200 * count_of(KEY_QUERIES);
+        }
+        else if (request_type == KEY_REACHABLE_STOPS_REQ)
+        {
+            return 200 * count_of(KEY_NAMES);
+        }
+        return 1;
+    }
+
+    // Запросы дороже этого выполняются отдельными задачами, дешёвые собираются в задачи примерно
+    // такой суммарной стоимости
+    const size_t TASK_COST = 256;
+
+    // Ответы на различные запросы, которые рабочие потоки заполняют в любом порядке, а читатель
+    // забирает по порядку, как только готов очередной
+    class ResponseBuffer
+    {
+    public:
+        explicit ResponseBuffer(size_t size)
+            : responses_(size), errors_(size), is_ready_(size, false)
+        {}
+
+        void Set(size_t index, std::optional<StatResponse> response, std::exception_ptr error)
+        {
+            std::lock_guard guard(mutex_);
+            responses_[index] = std::move(response);
+            errors_[index] = std::move(error);
+            is_ready_[index] = true;
+            ++ready_count_;
+            if (index == waited_index_ || ready_count_ == is_ready_.size())
+            {
+                ready_.notify_one();
+            }
+        }
+
+        // Дожидается ответа index; ошибку его вычисления пробрасывает
+        std::optional<StatResponse>& Wait(size_t index)
+        {
+            std::unique_lock lock(mutex_);
+            waited_index_ = index;
+            ready_.wait(lock, [this, index] {
+                return is_ready_[index];
+            });
+            waited_index_ = SIZE_MAX;
+
+            if (errors_[index])
+            {
+                std::rethrow_exception(errors_[index]);
+            }
+            return responses_[index];
+        }
+
+        void WaitAll()
+        {
+            std::unique_lock lock(mutex_);
+            ready_.wait(lock, [this] {
+                return ready_count_ == is_ready_.size();
+            });
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable ready_;
+        std::vector<std::optional<StatResponse>> responses_;
+        std::vector<std::exception_ptr> errors_;
+        std::vector<bool> is_ready_;
+        size_t ready_count_ = 0;
+        size_t waited_index_ = SIZE_MAX;
+    };
+
+    // stat_requests, сгруппированные по ключу. Запросы добавляются по одному по мере разбора;
+    // после запроса, для которого не удалось составить ключ, остальные не добавляются, так как
+    // ответ на нём всё равно оборвётся
+    struct StatRequestPlan
+    {
+        void Add(json::Node request)
+        {
+            if (is_truncated)
+            {
+                return;
+            }
+
+            std::string key;
+            try
+            {
+                key = MakeRequestKey(request);
+            }
+            catch (const json::JsonException& e)
+            {
+                is_truncated = true;
+                return;
+            }
+
+            const auto [it, inserted] = distinct_indexes.emplace(std::move(key), distinct_keys.size());
+            if (inserted)
+            {
+                distinct_keys.push_back(&it->first);
+                distinct_request_indexes.push_back(requests.size());
+            }
+            request_distinct_indexes.push_back(it->second);
+            requests.push_back(std::move(request));
+        }
+
+        json::Node::Array requests;
+        std::unordered_map<std::string, size_t> distinct_indexes;
+        std::vector<const std::string*> distinct_keys;
+        // Первое вхождение каждого различного запроса в requests
+        std::vector<size_t> distinct_request_indexes;
+        std::vector<size_t> request_distinct_indexes;
+        bool is_truncated = false;
+    };
+
+    // Ответ из кэша выводится как есть, в него только вписывается request_id
+    void PrintStatResponse(json::ArrayPrinter& printer, StatResponse response, int request_id)
+    {
+        if (response.cached)
+        {
+            const std::string_view text = response.cached->text;
+            const size_t offset = response.cached->request_id_offset;
+            printer.StartRawItem() << text.substr(0, offset) << request_id << text.substr(offset);
+            return;
+        }
+
+        response.object[KEY_REQUEST_ID] = request_id;
+        printer.Print(std::move(response.object));
+    }
+
+    // Одинаковые запросы вычисляются один раз, и ответ на каждый различный запрос раздаётся всем id
+    // его группы в исходном порядке. Различные запросы вычисляются задачами планировщика: дорогие —
+    // по отдельности и первыми, от самых дорогих, их внутренние параллельные циклы становятся
+    // подзадачами; дешёвые — пачками по порядку. Без планировщика запросы вычисляются по очереди
+    // в вызывающем потоке. on_response получает ответы в исходном порядке по мере готовности очередного.
+    // Как и при поочерёдной обработке, ошибка в запросе обрывает ответ на нём, а ответы на предыдущие
+    // запросы сохраняются
+    void SendStatRequests(const transport::RequestHandler& request_handler, StatRequestPlan& plan,
+                          transport::TaskScheduler* scheduler, transport::StatRequestStats& stats,
+                          const std::function<void(StatResponse, int)>& on_response)
+    {
+        const size_t distinct_count = plan.distinct_keys.size();
+        stats.request_count += plan.requests.size();
+        stats.distinct_count += distinct_count;
+
+        // Последнее вхождение каждого различного запроса забирает ответ без копирования
+        std::vector<size_t> last_occurrences(distinct_count);
+        for (size_t i = 0; i < plan.requests.size(); ++i)
+        {
+            last_occurrences[plan.request_distinct_indexes[i]] = i;
+        }
+
+        ResponseBuffer buffer(distinct_count);
+        auto evaluate = [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i)
+            {
+                std::optional<StatResponse> response;
+                std::exception_ptr error;
+                try
+                {
+                    response = SendStatRequest(request_handler, plan.requests[plan.distinct_request_indexes[i]],
+                                               *plan.distinct_keys[i]);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+                buffer.Set(i, std::move(response), std::move(error));
+            }
+        };
+
+        std::vector<std::pair<size_t, size_t>> expensive;
+        std::vector<std::pair<size_t, size_t>> cheap_ranges;
+        size_t cheap_cost = 0;
+        for (size_t i = 0; scheduler && i < distinct_count; ++i)
+        {
+            const size_t cost = EstimateCost(plan.requests[plan.distinct_request_indexes[i]]);
+            if (cost > TASK_COST)
+            {
+                expensive.emplace_back(cost, i);
+                continue;
+            }
+            if (cheap_ranges.empty() || cheap_ranges.back().second != i || cheap_cost + cost > TASK_COST)
+            {
+                cheap_ranges.emplace_back(i, i);
+                cheap_cost = 0;
+            }
+            cheap_ranges.back().second = i + 1;
+            cheap_cost += cost;
+        }
+
+        std::stable_sort(expensive.begin(), expensive.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first > rhs.first;
+        });
+        for (const auto& [cost, i] : expensive)
+        {
+            scheduler->Submit([&evaluate, i = i] {
+                evaluate(i, i + 1);
+            });
+        }
+        for (const auto& [first, last] : cheap_ranges)
+        {
+            scheduler->Submit([&evaluate, first = first, last = last] {
+                evaluate(first, last);
+            });
+        }
+        if (!scheduler)
+        {
+            evaluate(0, distinct_count);
+        }
+
+        // Задачи ссылаются на запросы и буфер, поэтому до выхода дожидаемся всех, в том числе при ошибке
+        try
+        {
+            for (size_t i = 0; i < plan.requests.size(); ++i)
+            {
+                const size_t distinct_index = plan.request_distinct_indexes[i];
+                auto& response = buffer.Wait(distinct_index);
+                if (!response)
+                {
+                    continue;
+                }
+
+                const int request_id = plan.requests[i].At(KEY_ID).AsInt();
+                if (last_occurrences[distinct_index] == i)
+                {
+                    on_response(std::move(*response), request_id);
+                }
+                else
+                {
+                    on_response(*response, request_id);
+                }
+            }
+        }
+        catch (const json::JsonException& e)
+        {}
+        catch (...)
+        {
+            buffer.WaitAll();
+            throw;
+        }
+
+        buffer.WaitAll();
+    }
+}
+
+void transport::AnswerStatRequests(const RequestHandler& request_handler, std::istream& input, std::ostream& output)
+{
+    json::StreamReader reader(input);
+    StatRequestPlan stat_plan;
+
+    if (reader.StartObject())
+    {
+        while (auto key = reader.NextKey())
+        {
+            if (*key == KEY_STAT_R && reader.StartArray())
+            {
+                while (reader.NextItem())
+                {
+                    stat_plan.Add(reader.Load());
+                }
+            }
+            else
+            {
+                reader.Load();
+            }
+        }
+    }
+    else
+    {
+        reader.Load();
+    }
+
+    json::ArrayPrinter printer(output);
+    StatRequestStats stats;
+    const auto version_lock = request_handler.LockVersion();
+    SendStatRequests(request_handler, stat_plan, nullptr, stats, [&printer](StatResponse response, int request_id) {
+        PrintStatResponse(printer, std::move(response), request_id);
+    });
+    printer.Close();
+}
+
+JsonReader::JsonReader(RequestHandler& request_handler)
+    : request_handler_(request_handler)
+{
+    response_builder_.StartArray();
+}
+
+void JsonReader::SendJsonRequests(std::istream& input)
+{
+    SendRequests(input, [this](StatResponse response, int request_id) {
+        if (response.cached)
+        {
+            // Накопленные ответы выводятся документом целиком, поэтому текст из кэша разбирается
+            const auto& [text, offset] = *response.cached;
+            std::istringstream in(text.substr(0, offset) + std::to_string(request_id) + text.substr(offset));
+            response.object = json::Load(in).GetRoot().AsObject();
+        }
+        response.object[KEY_REQUEST_ID] = request_id;
+        response_builder_.Value(std::move(response.object));
+    });
+}
+
+void JsonReader::SendJsonRequests(std::istream& input, std::ostream& output)
+{
+    std::optional<json::ArrayPrinter> printer;
+    SendRequests(input, [&printer, &output](StatResponse response, int request_id) {
+        if (!printer)
+        {
+            printer.emplace(output);
+        }
+        PrintStatResponse(*printer, std::move(response), request_id);
+    });
+
+    if (!printer)
+    {
+        printer.emplace(output);
+    }
+    printer->Close();
+}
+
+StatRequestStats JsonReader::GetStatRequestStats() const
+{
+    return stat_request_stats_;
+}
+
+const std::vector<std::string>& JsonReader::GetDeltaErrors() const
+{
+    return delta_errors_;
+}
+
+void JsonReader::OutputJsonResponse(std::ostream& out)
+{
+    response_builder_.EndArray();
+    json::Print(json::Document(response_builder_.Build()), out);
     response_builder_.Clear();
-}
\ No newline at end of file
+}
+
+// Разбор, построение справочника и ответы идут конвейером. Вызывающий поток разбирает документ по полям:
+// base_requests по одному передаются потоку, который тут же переводит их в запросы обработчика, а после
+// конца массива строит справочник, пока разбирается остальной документ; stat_requests группируются
+// по ключу прямо при разборе. Остальные поля загружаются целиком. Изменения, настройки и ответы
+// применяются после разбора всего документа и построения справочника в том же порядке, что и раньше,
+// поскольку поля объекта могут идти в любом порядке
+void JsonReader::SendRequests(std::istream& input, const std::function<void(StatResponse, int)>& on_response)
+{
+    json::StreamReader reader(input);
+    if (!reader.StartObject())
+    {
+        reader.Load();
+        return;
+    }
+
+    BaseRequestQueue base_queue;
+    std::future<void> catalogue_built;
+    StatRequestPlan stat_plan;
+    bool has_stat_requests = false;
+    json::Node::Object other_requests;
+
+    try
+    {
+        std::unordered_set<std::string> keys;
+        while (auto key = reader.NextKey())
+        {
+            if (!keys.insert(*key).second)
+            {
+                throw json::ParsingError("Duplicate key '"s + *key + "' have been found"s);
+            }
+
+            if (*key == KEY_BASE_R)
+            {
+                if (!reader.StartArray())
+                {
+                    throw json::InvalidNodeType("Invalid value type"s);
+                }
+
+                catalogue_built = std::async(std::launch::async, [this, &base_queue] {
+                    BuildCatalogue(request_handler_, base_queue);
+                });
+
+                std::vector<json::Node> batch;
+                while (reader.NextItem())
+                {
+                    batch.push_back(reader.Load());
+                    if (batch.size() == BASE_REQUEST_BATCH_SIZE)
+                    {
+                        base_queue.Push(std::exchange(batch, {}));
+                    }
+                }
+                base_queue.Push(std::move(batch));
+                base_queue.Close();
+            }
+            else if (*key == KEY_STAT_R && reader.StartArray())
+            {
+                has_stat_requests = true;
+                while (reader.NextItem())
+                {
+                    stat_plan.Add(reader.Load());
+                }
+            }
+            else
+            {
+                other_requests.emplace(std::move(*key), reader.Load());
+            }
+        }
+    }
+    catch (...)
+    {
+        // Ошибка разбора важнее ошибки построения, как и при загрузке документа целиком
+        base_queue.Close();
+        if (catalogue_built.valid())
+        {
+            catalogue_built.wait();
+        }
+        throw;
+    }
+
+    if (catalogue_built.valid())
+    {
+        catalogue_built.get();
+    }
+
+    const json::Node json_requests(std::move(other_requests));
+
+    if (json_requests.Contains(KEY_DELTA_R))
+    {
+        auto errors = SendDeltaRequests(request_handler_, json_requests.At(KEY_DELTA_R));
+        delta_errors_.insert(delta_errors_.end(), std::make_move_iterator(errors.begin()),
+                             std::make_move_iterator(errors.end()));
+    }
+
+    if (json_requests.Contains(KEY_RENDER_S))
+    {
+        SendRenderSettings(request_handler_, json_requests.At(KEY_RENDER_S));
+    }
+
+    if (json_requests.Contains(KEY_ROUTING_S))
+    {
+        SendRoutingSettings(request_handler_, json_requests.At(KEY_ROUTING_S));
+    }
+
+    if (json_requests.Contains(KEY_CACHE_S))
+    {
+        SendCacheSettings(request_handler_, json_requests.At(KEY_CACHE_S));
+    }
+
+    if (has_stat_requests)
+    {
+        if (!scheduler_)
+        {
+            scheduler_ = std::make_unique<TaskScheduler>();
+        }
+        const auto version_lock = request_handler_.LockVersion();
+        SendStatRequests(request_handler_, stat_plan, scheduler_.get(), stat_request_stats_, on_response);
+    }
+}
@@ -1,10 +1,30 @@
 #pragma once
 #include "request_handler.h"
 #include "json_builder.h"
+#include "task_scheduler.h"
+#include <functional>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <vector>
 
 namespace transport
 {
+    // Сколько stat_requests пришло и сколько из них различных, то есть действительно вычислялось
+    struct StatRequestStats
+    {
+        size_t request_count = 0;
+        size_t distinct_count = 0;
+    };
+
+    // Отвечает на stat_requests из документа input, пропуская остальные поля, и выводит ответы в output
+    // так же, как JsonReader. Обработчик не меняется, поэтому вызовы с одним обработчиком могут идти
+    // параллельно; различные запросы вычисляются по очереди в вызывающем потоке
+    void AnswerStatRequests(const RequestHandler& request_handler, std::istream& input, std::ostream& output);
+
+    // Ответ на stat-запрос, определён в json_reader.cpp
+    struct StatResponse;
+
     class JsonReader
     {
     public:
@@ -12,10 +32,27 @@ namespace transport
 
         void SendJsonRequests(std::istream &input);
 
+        // Ответы на stat_requests выводятся в output по мере готовности очередного, в исходном порядке,
+        // одним JSON-массивом — как SendJsonRequests(input) и OutputJsonResponse(output) для читателя
+        // без накопленных ответов
+        void SendJsonRequests(std::istream &input, std::ostream &output);
+
         void OutputJsonResponse(std::ostream &out);
 
+        StatRequestStats GetStatRequestStats() const;
+
+        // Ошибочные элементы delta_requests. Пакет с ними не применяется, а stat_requests отвечаются
+        // по справочнику без изменений
+        const std::vector<std::string>& GetDeltaErrors() const;
+
     private:
+        void SendRequests(std::istream& input, const std::function<void(StatResponse, int)>& on_response);
+
         RequestHandler& request_handler_;
         json::Builder response_builder_;
+        StatRequestStats stat_request_stats_;
+        std::vector<std::string> delta_errors_;
+        // Создаётся при первых stat_requests
+        std::unique_ptr<TaskScheduler> scheduler_;
     };
 }
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include "load_generator.h"
+#include "json.h"
+#include "request_server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace transport;
+using namespace std::literals;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const size_t READ_BUFFER_SIZE = 64 << 10;
+    const size_t MAX_FRAME_SIZE = size_t(1) << 30;
+
+    struct ConnectionLoad
+    {
+        int fd = -1;
+        // Запланированные моменты отправки запросов, ответы на которые ещё не пришли
+        std::mutex mutex;
+        std::deque<Clock::time_point> sent_times;
+        size_t sent_count = 0;
+        std::vector<Clock::duration> latencies;
+        size_t error_count = 0;
+        Clock::time_point last_answer_time;
+    };
+
+    void SendAll(int fd, std::string_view data)
+    {
+        while (!data.empty())
+        {
+            const ssize_t size = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (size < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "send");
+            }
+            data.remove_prefix(size);
+        }
+    }
+
+    void SendRequests(ConnectionLoad& load, const std::vector<std::string>& frames, size_t first,
+                      size_t step, double target_qps, Clock::time_point start, Clock::time_point finish)
+    {
+        for (size_t i = first;; i += step)
+        {
+            const auto time = start + std::chrono::duration_cast<Clock::duration>(
+                                          std::chrono::duration<double>(i / target_qps));
+            if (time >= finish)
+            {
+                break;
+            }
+            std::this_thread::sleep_until(time);
+            {
+                std::lock_guard guard(load.mutex);
+                load.sent_times.push_back(time);
+                ++load.sent_count;
+            }
+            SendAll(load.fd, frames[i % frames.size()]);
+        }
+    }
+
+    void ReceiveResponses(ConnectionLoad& load)
+    {
+        std::string input;
+        char buffer[READ_BUFFER_SIZE];
+
+        while (true)
+        {
+            const ssize_t size = recv(load.fd, buffer, sizeof(buffer), 0);
+            if (size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (size <= 0)
+            {
+                return;
+            }
+            input.append(buffer, size);
+
+            size_t consumed = 0;
+            std::string_view payload;
+            while (const size_t frame_size = FindFrame(std::string_view(input).substr(consumed), payload,
+                                                       MAX_FRAME_SIZE))
+            {
+                consumed += frame_size;
+                const auto now = Clock::now();
+                std::lock_guard guard(load.mutex);
+                // Ответ без запроса задержки не имеет и считается ошибкой сервера
+                if (load.sent_times.empty())
+                {
+                    ++load.error_count;
+                    continue;
+                }
+                load.latencies.push_back(now - load.sent_times.front());
+                load.sent_times.pop_front();
+                load.last_answer_time = now;
+                if (!payload.empty() && payload.front() == '{')
+                {
+                    ++load.error_count;
+                }
+            }
+            input.erase(0, consumed);
+        }
+    }
+
+    std::chrono::duration<double, std::milli> GetPercentile(const std::vector<Clock::duration>& sorted,
+                                                            double fraction)
+    {
+        if (sorted.empty())
+        {
+            return {};
+        }
+        const size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    }
+}
+
+std::vector<std::string> transport::MakeLoadRequests(std::istream& input)
+{
+    const json::Document document = json::Load(input);
+    const auto& root = document.GetRoot();
+    const json::Node* stat_requests = nullptr;
+    if (root.IsObject())
+    {
+        const auto it = root.AsObject().find("stat_requests"s);
+        stat_requests = it != root.AsObject().end() ? &it->second : nullptr;
+    }
+    if (!stat_requests || !stat_requests->IsArray())
+    {
+        throw std::invalid_argument("Load requests must be given as stat_requests");
+    }
+
+    std::vector<std::string> requests;
+    for (const auto& request : stat_requests->AsArray())
+    {
+        std::ostringstream output;
+        json::Print(json::Document(json::Node::Object{{"stat_requests"s, json::Node::Array{request}}}), output);
+        requests.push_back(output.str());
+    }
+    return requests;
+}
+
+LoadReport transport::RunLoadTest(std::string_view address, const std::vector<std::string>& requests,
+                                  const LoadSettings& settings)
+{
+    if (requests.empty() || settings.connection_count == 0 || !(settings.target_qps > 0.0))
+    {
+        throw std::invalid_argument("Load test needs requests, connections and a positive rate");
+    }
+
+    std::vector<std::string> frames;
+    frames.reserve(requests.size());
+    for (const auto& request : requests)
+    {
+        frames.push_back(MakeFrame(request));
+    }
+
+    std::deque<ConnectionLoad> loads(settings.connection_count);
+    for (auto& load : loads)
+    {
+        load.fd = ConnectSocket(address);
+    }
+
+    // Запрос с номером i отправляется через i / target_qps от начала, соединения берут номера по очереди
+    const auto start = Clock::now();
+    const auto finish = start + std::chrono::duration_cast<Clock::duration>(settings.duration);
+    std::vector<std::thread> threads;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto run = [&error_mutex, &error](auto func) {
+        try
+        {
+            func();
+            return true;
+        }
+        catch (...)
+        {
+            std::lock_guard guard(error_mutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+            return false;
+        }
+    };
+    for (size_t i = 0; i < loads.size(); ++i)
+    {
+        auto& load = loads[i];
+        // Сервер закроет соединение, ответив на всё отправленное; после ошибки ответов уже не ждут
+        threads.emplace_back([&, i] {
+            const bool is_sent = run([&] {
+                SendRequests(load, frames, i, loads.size(), settings.target_qps, start, finish);
+            });
+            shutdown(load.fd, is_sent ? SHUT_WR : SHUT_RDWR);
+        });
+        threads.emplace_back([&] {
+            if (!run([&] {
+                    ReceiveResponses(load);
+                }))
+            {
+                shutdown(load.fd, SHUT_RDWR);
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    for (auto& load : loads)
+    {
+        close(load.fd);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    LoadReport report;
+    std::vector<Clock::duration> latencies;
+    auto last_answer_time = start;
+    for (auto& load : loads)
+    {
+        report.sent_count += load.sent_count;
+        report.error_count += load.error_count;
+        latencies.insert(latencies.end(), load.latencies.begin(), load.latencies.end());
+        last_answer_time = std::max(last_answer_time, load.last_answer_time);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    report.answered_count = latencies.size();
+    report.elapsed = last_answer_time - start;
+    report.p50 = GetPercentile(latencies, 0.5);
+    report.p90 = GetPercentile(latencies, 0.9);
+    report.p99 = GetPercentile(latencies, 0.99);
+    report.max = GetPercentile(latencies, 1.0);
+    return report;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace transport
+{
+    struct LoadSettings
+    {
+        double target_qps = 100.0;
+        std::chrono::duration<double> duration{10.0};
+        size_t connection_count = 4;
+    };
+
+    struct LoadReport
+    {
+        size_t sent_count = 0;
+        size_t answered_count = 0;
+        // Ответы-объекты с error_message вместо массива ответов и ответы, на которые не было запросов
+        size_t error_count = 0;
+        std::chrono::duration<double> elapsed{};
+        std::chrono::duration<double, std::milli> p50{};
+        std::chrono::duration<double, std::milli> p90{};
+        std::chrono::duration<double, std::milli> p99{};
+        std::chrono::duration<double, std::milli> max{};
+    };
+
+    // Превращает каждый из stat_requests документа input в отдельный запрос к серверу
+    std::vector<std::string> MakeLoadRequests(std::istream& input);
+
+    // Шлёт на сервер requests по кругу с постоянным темпом target_qps, распределяя их по соединениям
+    // и не дожидаясь ответов. Задержка отсчитывается от запланированного момента отправки, поэтому
+    // в неё входит и ожидание, когда сервер не успевает
+    LoadReport RunLoadTest(std::string_view address, const std::vector<std::string>& requests,
+                           const LoadSettings& settings);
+}
@@ -1,15 +1,364 @@
 #include "transport_catalogue.h"
 #include "request_handler.h"
 #include "map_renderer.h"
+#include "json.h"
 #include "json_reader.h"
+#include "snapshot.h"
+#include "request_server.h"
+#include "load_generator.h"
+#include "benchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
-int main()
+using namespace std::literals;
+
+namespace
 {
+    const int BENCHMARK_REPEAT_COUNT = 5;
+    // Город для матрицы времени в пути: сетка 80 x 80 и 400 автобусов по 40 остановок
+    const transport::SyntheticCitySettings MATRIX_BENCHMARK_CITY{6400, 400, 40, 3};
+    const size_t MATRIX_BENCHMARK_SIZE = 2000;
+
+    void PrintUsage(std::ostream& stream = std::cerr)
+    {
+        stream << "Usage: transport_catalogue [--index-stats] [--compact-geometry] [--geometry-error] [make_snapshot <file> | serve_snapshot <file>]\n"sv
+               << "       transport_catalogue [--index-stats] listen_snapshot <file> <unix:path | tcp:port>\n"sv
+               << "       transport_catalogue load_test <unix:path | tcp:port> <requests_file> <qps> <seconds> [connections]\n"sv
+               << "       transport_catalogue bench map [stops] [buses]\n"sv
+               << "       transport_catalogue bench matrix [size]\n"sv;
+    }
+
+    void PrintIndexStats(const std::vector<transport::IndexBuildStats>& stats, std::ostream& stream = std::cerr)
+    {
+        for (const auto& index : stats)
+        {
+            const double build_ms = std::chrono::duration<double, std::milli>(index.build_time).count();
+            stream << index.name << ": "sv << (index.is_built ? "built"sv : "not built"sv)
+                   << ", builds: "sv << index.build_count << ", time: "sv << build_ms << " ms\n"sv;
+        }
+    }
+
+    void PrintResponseCacheStats(const transport::ResponseCacheStats& stats, std::ostream& stream = std::cerr)
+    {
+        stream << "response_cache: hits: "sv << stats.hits << ", misses: "sv << stats.misses
+               << ", evictions: "sv << stats.evictions << ", entries: "sv << stats.entry_count
+               << ", bytes: "sv << stats.byte_count << "\n"sv;
+    }
+
+    void PrintStatRequestStats(const transport::StatRequestStats& stats, std::ostream& stream = std::cerr)
+    {
+        const double dedup_ratio = stats.request_count
+                                   ? 1.0 - double(stats.distinct_count) / double(stats.request_count) : 0.0;
+        stream << "stat_requests: "sv << stats.request_count << ", distinct: "sv << stats.distinct_count
+               << ", dedup ratio: "sv << dedup_ratio << "\n"sv;
+    }
+
+    void PrintDeltaErrors(const std::vector<std::string>& errors, std::ostream& stream = std::cerr)
+    {
+        for (const auto& error : errors)
+        {
+            stream << "delta_requests rejected: "sv << error << "\n"sv;
+        }
+    }
+
+    void PrintServerStats(const transport::RequestServerStats& stats, std::ostream& stream = std::cerr)
+    {
+        stream << "server: connections: "sv << stats.connection_count << ", requests: "sv << stats.request_count
+               << "\n"sv;
+    }
+
+    void PrintLoadReport(const transport::LoadReport& report, double target_qps, std::ostream& stream = std::cout)
+    {
+        const double elapsed = report.elapsed.count();
+        stream << "requests: sent "sv << report.sent_count << ", answered "sv << report.answered_count
+               << ", errors "sv << report.error_count << "\n"sv
+               << "throughput: "sv << (elapsed > 0.0 ? report.answered_count / elapsed : 0.0)
+               << " req/s, target "sv << target_qps << " req/s\n"sv
+               << "latency: p50 "sv << report.p50.count() << " ms, p90 "sv << report.p90.count()
+               << " ms, p99 "sv << report.p99.count() << " ms, max "sv << report.max.count() << " ms\n"sv;
+    }
+
+    // Разбирает аргументы load_test: <address> <requests_file> <qps> <seconds> [connections]
+    int RunLoadTest(int argc, const char** argv)
+    {
+        transport::LoadSettings settings;
+        try
+        {
+            settings.target_qps = std::stod(argv[4]);
+            settings.duration = std::chrono::duration<double>(std::stod(argv[5]));
+            if (argc == 7)
+            {
+                settings.connection_count = std::stoul(argv[6]);
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        std::ifstream requests_file(argv[3]);
+        if (!requests_file)
+        {
+            std::cerr << "Cannot open "sv << argv[3] << std::endl;
+            return 1;
+        }
+
+        const auto report = transport::RunLoadTest(argv[2], transport::MakeLoadRequests(requests_file), settings);
+        PrintLoadReport(report, settings.target_qps);
+        return 0;
+    }
+
+    // Разбирает аргументы bench: map [stops] [buses] или matrix [size]
+    int RunBenchmark(int argc, const char** argv)
+    {
+        const std::string_view kind(argv[2]);
+        const bool is_map = kind == "map"sv;
+        transport::SyntheticCitySettings city = is_map ? transport::SyntheticCitySettings{} : MATRIX_BENCHMARK_CITY;
+        size_t matrix_size = MATRIX_BENCHMARK_SIZE;
+        try
+        {
+            if (is_map && argc > 3)
+            {
+                city.stop_count = std::stoul(argv[3]);
+            }
+            if (is_map && argc > 4)
+            {
+                city.bus_count = std::stoul(argv[4]);
+            }
+            if (!is_map && argc > 3)
+            {
+                matrix_size = std::stoul(argv[3]);
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            PrintUsage();
+            return 1;
+        }
+        if (!is_map && (kind != "matrix"sv || argc > 4))
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        const auto catalogue = transport::MakeSyntheticCity(city);
+        std::cout << "city: "sv << catalogue.GetStopCount() << " stops, "sv << catalogue.GetBuses().size()
+                  << " buses\n"sv;
+
+        if (is_map)
+        {
+            const auto report = transport::RunMapBenchmark(catalogue, BENCHMARK_REPEAT_COUNT);
+            std::cout << "svg: "sv << report.svg_bytes << " bytes, "sv << report.svg_time.count() << " ms\n"sv
+                      << "tile: "sv << report.tile_bytes << " bytes, "sv << report.tile_time.count() << " ms\n"sv;
+        }
+        else
+        {
+            const auto report = transport::RunMatrixBenchmark(catalogue, matrix_size, BENCHMARK_REPEAT_COUNT,
+                                                              city.seed);
+            std::cout << "matrix: "sv << report.cell_count << " cells, "sv << report.time.count() << " ms, "sv
+                      << report.cells_per_second << " cells/s\n"sv;
+        }
+        return 0;
+    }
+
+    // Сравнивает расстояния между соседними остановками маршрутов по компактной геометрии
+    // с расчётом по исходным координатам
+    void PrintGeometryError(const transport::Catalogue& catalogue, std::ostream& stream = std::cerr)
+    {
+        const auto& geometry = catalogue.GetStopGeometry();
+        const auto& stops = catalogue.GetStops();
+        size_t pair_count = 0;
+        double max_error = 0.0, total_error = 0.0, max_relative_error = 0.0;
+
+        for (const auto& [bus_name, bus] : catalogue.GetBuses())
+        {
+            for (size_t i = 0; i + 1 < bus->stop_ids.size(); ++i)
+            {
+                const size_t from = bus->stop_ids[i], to = bus->stop_ids[i + 1];
+                const double exact = transport::ComputeDistance(stops[from]->coordinates, stops[to]->coordinates);
+                const double error = std::abs(geometry.ComputeDistance(from, to) - exact);
+                max_error = std::max(max_error, error);
+                total_error += error;
+                if (exact > 0.0)
+                {
+                    max_relative_error = std::max(max_relative_error, error / exact);
+                }
+                ++pair_count;
+            }
+        }
+
+        const size_t bytes = geometry.coordinates.size() * (sizeof(transport::FixedCoordinates) + sizeof(transport::UnitVector));
+        stream << "compact geometry: "sv << geometry.coordinates.size() << " stops, "sv << bytes << " bytes\n"sv
+               << "distance error over "sv << pair_count << " stop pairs: max "sv << max_error << " m, mean "sv
+               << (pair_count ? total_error / pair_count : 0.0) << " m, max relative "sv << max_relative_error << "\n"sv;
+    }
+}
+
+// Без аргументов запросы читаются из stdin целиком.
+// make_snapshot <file>  — строит справочник из base_requests в stdin и сохраняет его снимок в file;
+// serve_snapshot <file> — загружает снимок из file и отвечает на stat_requests из stdin;
+// listen_snapshot <file> <address> — загружает снимок, применяет настройки из stdin и отвечает на stat_requests
+//                      клиентов по адресу unix:<путь> или tcp:<порт> до SIGINT или SIGTERM;
+// load_test <address> <requests_file> <qps> <seconds> [connections] — нагружает сервер stat_requests из
+//                      requests_file с заданным темпом и выводит задержки ответов;
+// bench map [stops] [buses] — строит синтетический город и сравнивает размер и время вывода карты
+//                      в SVG и в бинарном тайле;
+// bench matrix [size] — считает на синтетическом городе матрицу времени в пути size x size и выводит
+//                      число ячеек в секунду.
+// Ключи перед режимом:
+// --index-stats      — после работы вывести в stderr, какие производные индексы строились и сколько времени это заняло,
+//                      счётчики кэша ответов и долю повторных stat_requests;
+// --compact-geometry — считать длины маршрутов по компактной геометрии остановок;
+// --geometry-error   — вывести в stderr расхождение расстояний по компактной геометрии с точным расчётом.
+int main(int argc, const char** argv)
+{
+    // Запросы разбираются в одном потоке, пока в других строится справочник и готовятся ответы.
+    // Синхронизированный с stdio std::cin в многопоточной программе берёт блокировку на каждый символ
+    std::ios_base::sync_with_stdio(false);
+
     transport::Catalogue transport_catalogue;
     transport::MapRenderer renderer;
-    transport::RequestHandler handler(transport_catalogue, renderer);
-    transport::JsonReader reader(handler);
 
-    reader.SendJsonRequests(std::cin);
-    reader.OutputJsonResponse(std::cout);
-}
\ No newline at end of file
+    bool print_index_stats = false;
+    bool print_geometry_error = false;
+    for (; argc > 1 && std::string_view(argv[1]).substr(0, 2) == "--"sv; --argc, ++argv)
+    {
+        const std::string_view option(argv[1]);
+        if (option == "--index-stats"sv)
+        {
+            print_index_stats = true;
+        }
+        else if (option == "--compact-geometry"sv)
+        {
+            transport_catalogue.SetCompactGeometry(true);
+        }
+        else if (option == "--geometry-error"sv)
+        {
+            print_geometry_error = true;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    try
+    {
+        if (argc == 1)
+        {
+            transport::VersionedCatalogue catalogue(std::move(transport_catalogue));
+            transport::RequestHandler handler(catalogue, renderer);
+            transport::JsonReader reader(handler);
+            reader.SendJsonRequests(std::cin, std::cout);
+            PrintDeltaErrors(reader.GetDeltaErrors());
+            if (print_geometry_error)
+            {
+                PrintGeometryError(*catalogue.Get());
+            }
+            if (print_index_stats)
+            {
+                auto stats = catalogue.Get()->GetIndexStats();
+                stats.push_back(renderer.GetLayoutStats());
+                stats.push_back(handler.GetRoutingGraphStats());
+                stats.push_back(handler.GetTimetableStats());
+                PrintIndexStats(stats);
+                PrintResponseCacheStats(handler.GetResponseCacheStats());
+                PrintStatRequestStats(reader.GetStatRequestStats());
+            }
+            return 0;
+        }
+
+        const std::string_view mode(argc > 1 ? argv[1] : "");
+        const bool is_valid = ((mode == "make_snapshot"sv || mode == "serve_snapshot"sv) && argc == 3)
+                              || (mode == "listen_snapshot"sv && argc == 4)
+                              || (mode == "load_test"sv && (argc == 6 || argc == 7))
+                              || (mode == "bench"sv && argc >= 3 && argc <= 5);
+        if (!is_valid)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        if (mode == "make_snapshot"sv)
+        {
+            transport::VersionedCatalogue catalogue(std::move(transport_catalogue));
+            transport::RequestHandler handler(catalogue, renderer);
+            transport::JsonReader reader(handler);
+            reader.SendJsonRequests(std::cin);
+            PrintDeltaErrors(reader.GetDeltaErrors());
+            const auto built_catalogue = catalogue.Get();
+            transport::SaveSnapshot(*built_catalogue, argv[2]);
+            if (print_geometry_error)
+            {
+                PrintGeometryError(*built_catalogue);
+            }
+            if (print_index_stats)
+            {
+                PrintIndexStats(built_catalogue->GetIndexStats());
+            }
+        }
+        else if (mode == "serve_snapshot"sv)
+        {
+            // Запросы обслуживаются прямо по отображённому в память снимку, без загрузки в Catalogue
+            const transport::MappedCatalogue mapped_catalogue(argv[2]);
+            transport::RequestHandler handler(mapped_catalogue, renderer);
+            transport::JsonReader reader(handler);
+            reader.SendJsonRequests(std::cin, std::cout);
+            if (print_index_stats)
+            {
+                PrintIndexStats({renderer.GetLayoutStats(), handler.GetRoutingGraphStats(), handler.GetTimetableStats()});
+                PrintResponseCacheStats(handler.GetResponseCacheStats());
+                PrintStatRequestStats(reader.GetStatRequestStats());
+            }
+        }
+        else if (mode == "listen_snapshot"sv)
+        {
+            // Сигналы остановки принимает сервер, поэтому они блокируются раньше, чем появятся другие потоки
+            sigset_t signals;
+            sigemptyset(&signals);
+            sigaddset(&signals, SIGINT);
+            sigaddset(&signals, SIGTERM);
+            pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+            const transport::MappedCatalogue mapped_catalogue(argv[2]);
+            transport::RequestHandler handler(mapped_catalogue, renderer);
+            {
+                transport::JsonReader reader(handler);
+                reader.SendJsonRequests(std::cin, std::cout);
+            }
+
+            transport::TaskScheduler scheduler;
+            transport::RequestServer server(handler, scheduler);
+            server.Listen(argv[3]);
+            server.Run();
+            if (print_index_stats)
+            {
+                PrintIndexStats({renderer.GetLayoutStats(), handler.GetRoutingGraphStats(), handler.GetTimetableStats()});
+                PrintResponseCacheStats(handler.GetResponseCacheStats());
+                PrintServerStats(server.GetStats());
+            }
+        }
+        else if (mode == "load_test"sv)
+        {
+            return RunLoadTest(argc, argv);
+        }
+        else
+        {
+            return RunBenchmark(argc, argv);
+        }
+    }
+    catch (...)
+    {
+        std::cerr << json::GetCurrentErrorMessage() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,9 +1,15 @@
 #include "map_renderer.h"
 #include "geo.h"
+#include "tile.h"
+#include "parallel.h"
 #include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <optional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
 
 using namespace transport;
 
@@ -16,6 +22,8 @@ namespace
     const std::string DEFAULT_FONT_WEIGHT{"bold"s};
 
     inline const double EPSILON = 1e-6;
+    // Точность координат тайла по умолчанию: десятые доли пикселя
+    inline const int DEFAULT_TILE_PRECISION = 1;
 
     bool IsZero(double value) {
         return std::abs(value) < EPSILON;
@@ -23,7 +31,7 @@ namespace
 
     class SphereProjector {
     public:
-        // points_begin и points_end задают начало и конец интервала элементов geo::Coordinates
+        // points_begin и points_end задают начало и конец интервала элементов Coordinates
         template<typename PointInputIt>
         SphereProjector(PointInputIt points_begin, PointInputIt points_end,
                         double max_width, double max_height, double padding)
@@ -37,16 +45,16 @@ namespace
             // Находим точки с минимальной и максимальной долготой
             const auto [left_it, right_it] = std::minmax_element(
                     points_begin, points_end,
-                    [](auto lhs, auto rhs) { return lhs.second.lng < rhs.second.lng; });
-            min_lon_ = left_it->second.lng;
-            const double max_lon = right_it->second.lng;
+                    [](auto lhs, auto rhs) { return lhs.lng < rhs.lng; });
+            min_lon_ = left_it->lng;
+            const double max_lon = right_it->lng;
 
             // Находим точки с минимальной и максимальной широтой
             const auto [bottom_it, top_it] = std::minmax_element(
                     points_begin, points_end,
-                    [](auto lhs, auto rhs) { return lhs.second.lat < rhs.second.lat; });
-            const double min_lat = bottom_it->second.lat;
-            max_lat_ = top_it->second.lat;
+                    [](auto lhs, auto rhs) { return lhs.lat < rhs.lat; });
+            const double min_lat = bottom_it->lat;
+            max_lat_ = top_it->lat;
 
             // Вычисляем коэффициент масштабирования вдоль координаты x
             std::optional<double> width_zoom;
@@ -88,155 +96,564 @@ namespace
         double zoom_coeff_ = 0;
     };
 
-    svg::Polyline GetBusPolyline(const Bus& bus, const RenderSettings& render_settings, size_t color_count, const SphereProjector& proj)
+    // Имена CSS-классов компактного режима
+    const std::string CLASS_ROUTE{"r"s};
+    const std::string CLASS_BUS_LABEL{"b"s};
+    const std::string CLASS_STOP_CIRCLE{"sc"s};
+    const std::string CLASS_STOP_LABEL{"sl"s};
+
+    std::string ToCss(const svg::Color& color)
+    {
+        std::ostringstream out;
+        out << color;
+        return out.str();
+    }
+
+    // Подложка подписи — обводка того же элемента, которая рисуется под заливкой
+    std::string GetUnderlayerCss(const RenderSettings& render_settings)
+    {
+        std::ostringstream out;
+        out << "stroke:"sv << render_settings.underlayer_color
+            << ";stroke-width:"sv << render_settings.underlayer_width
+            << ";stroke-linecap:round;stroke-linejoin:round;paint-order:stroke"sv;
+        return out.str();
+    }
+
+    // Правила для всех классов компактного режима; для каждого цвета палитры — свой класс линии и подписи
+    svg::Style GetCompactStyle(const RenderSettings& render_settings)
+    {
+        svg::Style style;
+        const std::string underlayer = GetUnderlayerCss(render_settings);
+        const std::string bus_font = "font-size:"s + std::to_string(render_settings.bus_label_font_size)
+                + "px;font-family:"s + DEFAULT_FONT_FAMILY + ";font-weight:"s + DEFAULT_FONT_WEIGHT;
+        const std::string stop_font = "font-size:"s + std::to_string(render_settings.stop_label_font_size)
+                + "px;font-family:"s + DEFAULT_FONT_FAMILY;
+
+        std::ostringstream line_width;
+        line_width << render_settings.line_width;
+
+        for (size_t i = 0; i < render_settings.color_palette.size(); ++i)
+        {
+            const std::string color = ToCss(render_settings.color_palette[i]);
+            style.AddRule('.' + CLASS_ROUTE + std::to_string(i),
+                          "fill:none;stroke:"s + color + ";stroke-width:"s + line_width.str()
+                          + ";stroke-linecap:round;stroke-linejoin:round"s);
+            style.AddRule('.' + CLASS_BUS_LABEL + std::to_string(i),
+                          "fill:"s + color + ';' + underlayer + ';' + bus_font);
+        }
+
+        style.AddRule('.' + CLASS_STOP_CIRCLE, "fill:"s + DEFAULT_CIRCLE_COLOR);
+        style.AddRule('.' + CLASS_STOP_LABEL, "fill:"s + DEFAULT_TEXT_COLOR + ';' + underlayer + ';' + stop_font);
+        return style;
+    }
+
+    svg::Polyline GetBusPolyline(const Route& route, const RenderSettings& render_settings, size_t color_count, const std::vector<svg::Point>& stop_points)
     {
         svg::Polyline polyline{};
-        polyline.SetStrokeColor(render_settings.color_palette[color_count])
-                .SetFillColor(svg::NoneColor)
-                .SetStrokeWidth(render_settings.line_width)
-                .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-                .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
 
-        for (const auto stop_ptr: bus.bus_stops)
+        if (render_settings.compact_svg)
+        {
+            polyline.SetClassName(CLASS_ROUTE + std::to_string(color_count));
+        }
+        else
+        {
+            polyline.SetStrokeColor(render_settings.color_palette[color_count])
+                    .SetFillColor(svg::NoneColor)
+                    .SetStrokeWidth(render_settings.line_width)
+                    .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+                    .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+        }
+
+        for (const size_t stop_id : route.stop_ids)
         {
-            polyline.AddPoint(proj(stop_ptr->coordinates));
+            polyline.AddPoint(stop_points[stop_id]);
         }
 
-        if (!bus.is_roundtrip)
+        if (!route.is_roundtrip)
         {
-            for (auto it = bus.bus_stops.rbegin() + 1; it != bus.bus_stops.rend(); ++it)
+            for (auto it = route.stop_ids.rbegin() + 1; it != route.stop_ids.rend(); ++it)
             {
-                polyline.AddPoint(proj((*it)->coordinates));
+                polyline.AddPoint(stop_points[*it]);
             }
         }
 
         return polyline;
     }
 
-    svg::Text GetBusNameText(const std::string& name, svg::Point pos, const RenderSettings& render_settings)
+    // Общая часть подписи; в компактном режиме смещение учитывается в позиции, а размер шрифта задаётся классом
+    svg::Text GetLabel(std::string data, svg::Point pos, std::pair<double, double> offset, int font_size, const RenderSettings& render_settings)
     {
-        return svg::Text()
-                    .SetFillColor(render_settings.underlayer_color)
-                    .SetStrokeColor(render_settings.underlayer_color)
-                    .SetStrokeWidth(render_settings.underlayer_width)
-                    .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-                    .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)
-                    .SetPosition(pos)
-                    .SetOffset({render_settings.bus_label_offset.first, render_settings.bus_label_offset.second})
-                    .SetFontSize(render_settings.bus_label_font_size)
-                    .SetFontFamily(DEFAULT_FONT_FAMILY)
-                    .SetFontWeight(DEFAULT_FONT_WEIGHT)
-                    .SetData(name);
+        svg::Text text;
+        text.SetData(std::move(data));
+
+        if (render_settings.compact_svg)
+        {
+            return text.SetPosition({pos.x + offset.first, pos.y + offset.second})
+                       .ResetOffset()
+                       .ResetFontSize();
+        }
+
+        return text.SetPosition(pos)
+                   .SetOffset({offset.first, offset.second})
+                   .SetFontSize(font_size);
+    }
+
+    svg::Text GetBusNameText(std::string_view name, svg::Point pos, const RenderSettings& render_settings)
+    {
+        svg::Text text = GetLabel(std::string{name}, pos, render_settings.bus_label_offset, render_settings.bus_label_font_size, render_settings);
+
+        return text.SetFillColor(render_settings.underlayer_color)
+                   .SetStrokeColor(render_settings.underlayer_color)
+                   .SetStrokeWidth(render_settings.underlayer_width)
+                   .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+                   .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)
+                   .SetFontFamily(DEFAULT_FONT_FAMILY)
+                   .SetFontWeight(DEFAULT_FONT_WEIGHT);
     }
 
-    svg::Text GetBusNameTextBackground(const std::string& name, svg::Point pos, const RenderSettings& render_settings, size_t color_count)
+    svg::Text GetBusNameTextBackground(std::string_view name, svg::Point pos, const RenderSettings& render_settings, size_t color_count)
     {
-        return svg::Text()
-                    .SetFillColor(render_settings.color_palette[color_count])
-                    .SetPosition(pos)
-                    .SetOffset({render_settings.bus_label_offset.first, render_settings.bus_label_offset.second})
-                    .SetFontSize(render_settings.bus_label_font_size)
-                    .SetFontFamily(DEFAULT_FONT_FAMILY)
-                    .SetFontWeight(DEFAULT_FONT_WEIGHT)
-                    .SetData(name);
+        svg::Text text = GetLabel(std::string{name}, pos, render_settings.bus_label_offset, render_settings.bus_label_font_size, render_settings);
+
+        if (render_settings.compact_svg)
+        {
+            return text.SetClassName(CLASS_BUS_LABEL + std::to_string(color_count));
+        }
+
+        return text.SetFillColor(render_settings.color_palette[color_count])
+                   .SetFontFamily(DEFAULT_FONT_FAMILY)
+                   .SetFontWeight(DEFAULT_FONT_WEIGHT);
+    }
+
+    // В компактном режиме подложка — обводка самой подписи, поэтому подпись выводится одним элементом
+    void AddBusNameLabel(svg::Document& document, std::string_view name, svg::Point pos, const RenderSettings& render_settings, size_t color_count)
+    {
+        if (!render_settings.compact_svg)
+        {
+            document.Add(GetBusNameText(name, pos, render_settings));
+        }
+        document.Add(GetBusNameTextBackground(name, pos, render_settings, color_count));
     }
 
-    void AddBusNameText(svg::Document& document, const Bus& bus, const RenderSettings& render_settings, size_t color_count, const SphereProjector& proj)
+    void AddBusNameText(svg::Document& document, const Route& route, const RenderSettings& render_settings, size_t color_count, const std::vector<svg::Point>& stop_points)
     {
-        const auto first_stop = *bus.bus_stops.begin();
-        const auto last_stop = *bus.bus_stops.rbegin();
-        svg::Point first_pos = proj(first_stop->coordinates);
+        const size_t first_stop = route.stop_ids.front();
+        const size_t last_stop = route.stop_ids.back();
 
-        document.Add(GetBusNameText(bus.name, first_pos, render_settings));
-        document.Add(GetBusNameTextBackground(bus.name, first_pos, render_settings, color_count));
+        AddBusNameLabel(document, route.name, stop_points[first_stop], render_settings, color_count);
 
         if (first_stop != last_stop)
         {
-            svg::Point last_pos = proj(last_stop->coordinates);
-            document.Add(GetBusNameText(bus.name, last_pos, render_settings));
-            document.Add(GetBusNameTextBackground(bus.name, last_pos, render_settings, color_count));
+            AddBusNameLabel(document, route.name, stop_points[last_stop], render_settings, color_count);
         }
     }
 
     void AddStopNameText(svg::Document& document, std::string_view name, svg::Point pos, const RenderSettings& render_settings)
     {
-        document.Add(svg::Text()
-                             .SetFillColor(render_settings.underlayer_color)
-                             .SetStrokeColor(render_settings.underlayer_color)
-                             .SetStrokeWidth(render_settings.underlayer_width)
-                             .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
-                             .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)
-                             .SetPosition(pos)
-                             .SetOffset({render_settings.stop_label_offset.first, render_settings.stop_label_offset.second})
-                             .SetFontSize(render_settings.stop_label_font_size)
-                             .SetFontFamily(DEFAULT_FONT_FAMILY)
-                             .SetData(std::string{name}));
-
-        document.Add(svg::Text()
-                             .SetFillColor(DEFAULT_TEXT_COLOR)
-                             .SetPosition(pos)
-                             .SetOffset({render_settings.stop_label_offset.first, render_settings.stop_label_offset.second})
-                             .SetFontSize(render_settings.stop_label_font_size)
-                             .SetFontFamily(DEFAULT_FONT_FAMILY)
-                             .SetData(std::string{name}));
+        svg::Text label = GetLabel(std::string{name}, pos, render_settings.stop_label_offset, render_settings.stop_label_font_size, render_settings);
+
+        // В компактном режиме подложка — обводка самой подписи
+        if (render_settings.compact_svg)
+        {
+            label.SetClassName(CLASS_STOP_LABEL);
+            document.Add(std::move(label));
+            return;
+        }
+
+        svg::Text underlayer = label;
+        underlayer.SetFillColor(render_settings.underlayer_color)
+                  .SetStrokeColor(render_settings.underlayer_color)
+                  .SetStrokeWidth(render_settings.underlayer_width)
+                  .SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+                  .SetStrokeLineJoin(svg::StrokeLineJoin::ROUND)
+                  .SetFontFamily(DEFAULT_FONT_FAMILY);
+        label.SetFillColor(DEFAULT_TEXT_COLOR)
+             .SetFontFamily(DEFAULT_FONT_FAMILY);
+
+        document.Add(std::move(underlayer));
+        document.Add(std::move(label));
+    }
+
+    void AddStopCircle(svg::Document& document, svg::Point pos, const RenderSettings& render_settings)
+    {
+        svg::Circle circle;
+        circle.SetCenter(pos)
+              .SetRadius(render_settings.stop_radius);
+
+        if (render_settings.compact_svg)
+        {
+            circle.SetClassName(CLASS_STOP_CIRCLE);
+        }
+        else
+        {
+            circle.SetFillColor(DEFAULT_CIRCLE_COLOR);
+        }
+
+        document.Add(std::move(circle));
+    }
+
+    // Число знаков после запятой задаётся настройкой coordinate_precision, иначе используется формат потока по умолчанию
+    void SetNumberFormat(svg::Document& document, const RenderSettings& render_settings)
+    {
+        if (render_settings.coordinate_precision)
+        {
+            document.SetPrecision(*render_settings.coordinate_precision);
+        }
+    }
+
+    // Рендерит объекты, которые add_objects добавляет в документ, в отдельный буфер
+    template <typename ObjectAdder>
+    std::string RenderFragment(const RenderSettings& render_settings, ObjectAdder add_objects)
+    {
+        svg::Document document;
+        SetNumberFormat(document, render_settings);
+        add_objects(document);
+
+        std::ostringstream out;
+        document.RenderObjects(out);
+        return out.str();
+    }
+
+    bool operator==(svg::Point lhs, svg::Point rhs)
+    {
+        return lhs.x == rhs.x && lhs.y == rhs.y;
     }
 }
 
+// Раскладка карты: всё, что зависит только от версии справочника и настроек, но не от формата вывода
+struct MapRenderer::MapLayout
+{
+    const CatalogueReader* catalogue = nullptr;
+    uint64_t catalogue_version = 0;
+    // Спроецированные координаты и названия остановок, индекс — Stop::id
+    std::vector<svg::Point> stop_points;
+    std::vector<std::string_view> stop_names;
+    // Id остановок, через которые проходят автобусы, в порядке возрастания названий
+    std::vector<size_t> sorted_stop_ids;
+    // Непустые маршруты в порядке названий вместе с индексом цвета палитры
+    std::vector<std::pair<Route, size_t>> routes;
+};
+
+// Отрендеренные куски карты вместе с входными данными, по которым проверяется их актуальность
+struct MapRenderer::FragmentCache
+{
+    struct BusFragment
+    {
+        size_t color_count = 0;
+        bool is_roundtrip = false;
+        std::vector<svg::Point> stop_points;
+        std::string polyline;
+        std::string labels;
+
+        bool IsActual(const Route& route, size_t color, const std::vector<svg::Point>& points) const
+        {
+            return color_count == color && is_roundtrip == route.is_roundtrip
+                   && std::equal(stop_points.begin(), stop_points.end(), route.stop_ids.begin(), route.stop_ids.end(),
+                                 [&points](svg::Point point, size_t stop_id) { return point == points[stop_id]; });
+        }
+    };
+
+    struct StopFragment
+    {
+        std::optional<svg::Point> point;
+        std::string circle;
+        std::string label;
+    };
+
+    // Раскладка, для которой собран document
+    std::shared_ptr<const MapLayout> layout;
+    std::unordered_map<std::string, BusFragment> buses;
+    std::unordered_map<std::string, StopFragment> stops;
+    std::string document;
+};
+
 MapRenderer::MapRenderer(RenderSettings render_settings)
     : render_settings_(std::move(render_settings))
 {}
 
 void MapRenderer::SetRenderSettings(RenderSettings render_settings)
 {
+    std::scoped_lock guard(layout_mutex_, fragments_mutex_);
     render_settings_ = std::move(render_settings);
+    layout_.reset();
+    fragments_.reset();
 }
 
-svg::Document MapRenderer::Render(const std::map<std::string_view, const Bus*>& buses) const
+svg::Document MapRenderer::Render(const CatalogueReader& catalogue) const
 {
     svg::Document document;
-    std::map<std::string_view, Coordinates> name_to_coordinates;
+    SetNumberFormat(document, render_settings_);
+    const auto layout = GetLayout(catalogue);
+    const auto& points = layout->stop_points;
+
+    if (render_settings_.compact_svg)
+    {
+        document.Add(GetCompactStyle(render_settings_));
+    }
+
+    for (const auto& [route, color_count] : layout->routes)
+    {
+        document.Add(GetBusPolyline(route, render_settings_, color_count, points));
+    }
+
+    for (const auto& [route, color_count] : layout->routes)
+    {
+        AddBusNameText(document, route, render_settings_, color_count, points);
+    }
+
+    for (const size_t stop_id : layout->sorted_stop_ids)
+    {
+        AddStopCircle(document, points[stop_id], render_settings_);
+    }
+
+    for (const size_t stop_id : layout->sorted_stop_ids)
+    {
+        AddStopNameText(document, layout->stop_names[stop_id], points[stop_id], render_settings_);
+    }
+
+    return document;
+}
+
+void MapRenderer::Render(const CatalogueReader& catalogue, std::ostream& out) const
+{
+    const auto layout = GetLayout(catalogue);
+    std::lock_guard guard(fragments_mutex_);
+
+    if (!fragments_ || fragments_->layout != layout)
+    {
+        UpdateFragments(layout);
+    }
+
+    out << fragments_->document;
+}
+
+// Перерисовывает только куски, входные данные которых изменились, и собирает из кусков документ
+void MapRenderer::UpdateFragments(std::shared_ptr<const MapLayout> layout) const
+{
+    using BusFragment = FragmentCache::BusFragment;
+    using StopFragment = FragmentCache::StopFragment;
 
-    for (const auto& [bus_name, bus_ptr] : buses)
+    if (!fragments_)
     {
-        for (const auto stop_ptr : bus_ptr->bus_stops)
+        fragments_ = std::make_shared<FragmentCache>();
+    }
+
+    const RenderSettings& settings = render_settings_;
+    const auto& points = layout->stop_points;
+    FragmentCache& cache = *fragments_;
+
+    std::unordered_map<std::string, BusFragment> bus_fragments;
+    std::vector<BusFragment*> ordered_buses;
+    std::vector<size_t> stale_buses;
+    bus_fragments.reserve(layout->routes.size());
+    ordered_buses.reserve(layout->routes.size());
+
+    for (const auto& [route, color_count] : layout->routes)
+    {
+        std::string name{route.name};
+
+        if (const auto it = cache.buses.find(name); it != cache.buses.end())
+        {
+            bus_fragments[name] = std::move(it->second);
+        }
+
+        BusFragment& fragment = bus_fragments[std::move(name)];
+
+        if (fragment.polyline.empty() || !fragment.IsActual(route, color_count, points))
         {
-            name_to_coordinates.emplace(stop_ptr->name, stop_ptr->coordinates);
+            stale_buses.push_back(ordered_buses.size());
         }
+
+        ordered_buses.push_back(&fragment);
     }
 
-    const SphereProjector proj{
-                        name_to_coordinates.begin(), name_to_coordinates.end(),
-                        render_settings_.width,
-                        render_settings_.height,
-                        render_settings_.padding
-    };
+    std::unordered_map<std::string, StopFragment> stop_fragments;
+    std::vector<StopFragment*> ordered_stops;
+    std::vector<size_t> stale_stops;
+    stop_fragments.reserve(layout->sorted_stop_ids.size());
+    ordered_stops.reserve(layout->sorted_stop_ids.size());
 
-    size_t palette_size = render_settings_.color_palette.size();
-    size_t color_count = palette_size;
+    for (const size_t stop_id : layout->sorted_stop_ids)
+    {
+        std::string name{layout->stop_names[stop_id]};
+
+        if (const auto it = cache.stops.find(name); it != cache.stops.end())
+        {
+            stop_fragments[name] = std::move(it->second);
+        }
 
-    for (const auto& [bus_name, bus_ptr] : buses)
+        StopFragment& fragment = stop_fragments[std::move(name)];
+
+        if (!fragment.point || !(*fragment.point == points[stop_id]))
+        {
+            stale_stops.push_back(ordered_stops.size());
+        }
+
+        ordered_stops.push_back(&fragment);
+    }
+
+    ParallelFor(stale_buses.size(), [&](size_t i) {
+        const size_t route_index = stale_buses[i];
+        const auto& [route, color_count] = layout->routes[route_index];
+        BusFragment& fragment = *ordered_buses[route_index];
+
+        fragment.color_count = color_count;
+        fragment.is_roundtrip = route.is_roundtrip;
+        fragment.stop_points.clear();
+        for (const size_t stop_id : route.stop_ids)
+        {
+            fragment.stop_points.push_back(points[stop_id]);
+        }
+
+        fragment.polyline = RenderFragment(settings, [&](svg::Document& document) {
+            document.Add(GetBusPolyline(route, settings, color_count, points));
+        });
+        fragment.labels = RenderFragment(settings, [&](svg::Document& document) {
+            AddBusNameText(document, route, settings, color_count, points);
+        });
+    });
+
+    ParallelFor(stale_stops.size(), [&](size_t i) {
+        const size_t stop_id = layout->sorted_stop_ids[stale_stops[i]];
+        StopFragment& fragment = *ordered_stops[stale_stops[i]];
+
+        fragment.point = points[stop_id];
+        fragment.circle = RenderFragment(settings, [&](svg::Document& document) {
+            AddStopCircle(document, points[stop_id], settings);
+        });
+        fragment.label = RenderFragment(settings, [&](svg::Document& document) {
+            AddStopNameText(document, layout->stop_names[stop_id], points[stop_id], settings);
+        });
+    });
+
+    std::ostringstream document;
+    svg::Document::RenderBegin(document);
+
+    if (settings.compact_svg)
+    {
+        svg::Document style;
+        style.Add(GetCompactStyle(settings));
+        style.RenderObjects(document);
+    }
+
+    for (const auto fragment : ordered_buses)
     {
-        if (bus_ptr->bus_stops.empty())
+        document << fragment->polyline;
+    }
+
+    for (const auto fragment : ordered_buses)
+    {
+        document << fragment->labels;
+    }
+
+    for (const auto fragment : ordered_stops)
+    {
+        document << fragment->circle;
+    }
+
+    for (const auto fragment : ordered_stops)
+    {
+        document << fragment->label;
+    }
+
+    svg::Document::RenderEnd(document);
+
+    cache.layout = std::move(layout);
+    cache.buses = std::move(bus_fragments);
+    cache.stops = std::move(stop_fragments);
+    cache.document = document.str();
+}
+
+std::string MapRenderer::RenderTile(const CatalogueReader& catalogue) const
+{
+    const auto layout = GetLayout(catalogue);
+    const auto& points = layout->stop_points;
+
+    tile::Writer writer{render_settings_.width, render_settings_.height,
+                        render_settings_.coordinate_precision.value_or(DEFAULT_TILE_PRECISION)};
+    writer.SetPalette(render_settings_.color_palette);
+
+    writer.BeginLayer(tile::LayerType::ROUTES, layout->routes.size());
+    for (const auto& [route, color_count] : layout->routes)
+    {
+        const auto& stop_ids = route.stop_ids;
+        writer.AddUint(color_count)
+              .AddUint(route.is_roundtrip ? stop_ids.size() : stop_ids.size() * 2 - 1);
+
+        for (const size_t stop_id : stop_ids)
         {
-            continue;
+            writer.AddPoint(points[stop_id]);
         }
 
-        ++color_count;
-        if (color_count >= palette_size)
+        if (!route.is_roundtrip)
         {
-            color_count = 0;
+            for (auto it = stop_ids.rbegin() + 1; it != stop_ids.rend(); ++it)
+            {
+                writer.AddPoint(points[*it]);
+            }
         }
+    }
 
-        document.Add(GetBusPolyline(*bus_ptr, render_settings_, color_count, proj));
+    writer.BeginLayer(tile::LayerType::BUS_LABELS, layout->routes.size());
+    for (const auto& [route, color_count] : layout->routes)
+    {
+        const size_t first_stop = route.stop_ids.front();
+        const size_t last_stop = route.stop_ids.back();
+        writer.AddUint(color_count)
+              .AddString(route.name)
+              .AddUint(first_stop == last_stop ? 1 : 2)
+              .AddPoint(points[first_stop]);
+
+        if (first_stop != last_stop)
+        {
+            writer.AddPoint(points[last_stop]);
+        }
+    }
+
+    writer.BeginLayer(tile::LayerType::STOPS, layout->sorted_stop_ids.size());
+    for (const size_t stop_id : layout->sorted_stop_ids)
+    {
+        writer.AddString(layout->stop_names[stop_id])
+              .AddPoint(points[stop_id]);
     }
 
-    color_count = palette_size;
+    return writer.GetData();
+}
+
+std::shared_ptr<const MapRenderer::MapLayout> MapRenderer::GetLayout(const CatalogueReader& catalogue) const
+{
+    std::lock_guard guard(layout_mutex_);
 
-    for (const auto& [bus_name, bus_ptr] : buses)
+    if (layout_ && layout_->catalogue == &catalogue && layout_->catalogue_version == catalogue.GetVersion())
     {
-        if (bus_ptr->bus_stops.empty())
+        return layout_;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto layout = std::make_shared<MapLayout>();
+    layout->catalogue = &catalogue;
+    layout->catalogue_version = catalogue.GetVersion();
+
+    const size_t stop_count = catalogue.GetStopCount();
+    std::vector<bool> is_used(stop_count, false);
+    size_t palette_size = render_settings_.color_palette.size();
+    size_t color_count = palette_size;
+    layout->stop_names.resize(stop_count);
+
+    catalogue.ForEachRoute([&](Route route) {
+        if (route.stop_ids.empty())
+        {
+            return;
+        }
+
+        for (const size_t stop_id : route.stop_ids)
         {
-            continue;
+            if (!is_used[stop_id])
+            {
+                is_used[stop_id] = true;
+                layout->stop_names[stop_id] = catalogue.GetStopName(stop_id);
+                layout->sorted_stop_ids.push_back(stop_id);
+            }
         }
 
         ++color_count;
@@ -245,21 +662,44 @@ svg::Document MapRenderer::Render(const std::map<std::string_view, const Bus*>&
             color_count = 0;
         }
 
-        AddBusNameText(document, *bus_ptr, render_settings_, color_count, proj);
-    }
+        layout->routes.emplace_back(std::move(route), color_count);
+    });
+
+    const auto& names = layout->stop_names;
+    std::sort(layout->sorted_stop_ids.begin(), layout->sorted_stop_ids.end(), [&names](size_t lhs, size_t rhs) {
+        return names[lhs] < names[rhs];
+    });
 
-    for (const auto& [name, coordinates] : name_to_coordinates)
+    std::vector<Coordinates> used_coordinates;
+    used_coordinates.reserve(layout->sorted_stop_ids.size());
+
+    for (const size_t stop_id : layout->sorted_stop_ids)
     {
-        document.Add(svg::Circle()
-                                    .SetCenter(proj(coordinates))
-                                    .SetRadius(render_settings_.stop_radius)
-                                    .SetFillColor(DEFAULT_CIRCLE_COLOR));
+        used_coordinates.push_back(catalogue.GetStopCoordinates(stop_id));
     }
 
-    for (const auto& [name, coordinates] : name_to_coordinates)
+    const SphereProjector proj{
+                        used_coordinates.begin(), used_coordinates.end(),
+                        render_settings_.width,
+                        render_settings_.height,
+                        render_settings_.padding
+    };
+
+    layout->stop_points.resize(stop_count);
+
+    for (size_t i = 0; i < layout->sorted_stop_ids.size(); ++i)
     {
-        AddStopNameText(document, name, proj(coordinates), render_settings_);
+        layout->stop_points[layout->sorted_stop_ids[i]] = proj(used_coordinates[i]);
     }
 
-    return document;
+    layout_ = std::move(layout);
+    layout_build_time_ += std::chrono::steady_clock::now() - start;
+    ++layout_build_count_;
+    return layout_;
+}
+
+IndexBuildStats MapRenderer::GetLayoutStats() const
+{
+    std::lock_guard guard(layout_mutex_);
+    return {"map_layout", layout_ != nullptr, layout_build_count_, layout_build_time_};
 }
\ No newline at end of file
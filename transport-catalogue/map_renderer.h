@@ -1,10 +1,17 @@
 #pragma once
 #include "domain.h"
+#include "transport_catalogue.h"
 #include "svg.h"
 #include <vector>
 #include <utility>
 #include <map>
 #include <deque>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
 
 namespace transport
 {
@@ -15,6 +22,10 @@ namespace transport
         std::pair<double, double> bus_label_offset, stop_label_offset;
         svg::Color underlayer_color;
         std::vector<svg::Color> color_palette;
+        // Компактный режим: общие атрибуты выносятся в блок <style>, объекты ссылаются на них по классу
+        bool compact_svg = false;
+        // Если задано, числа в SVG выводятся с фиксированным количеством знаков после запятой
+        std::optional<int> coordinate_precision;
     };
 
     class MapRenderer
@@ -26,9 +37,33 @@ namespace transport
 
         void SetRenderSettings(RenderSettings render_settings);
 
-        svg::Document Render(const std::map<std::string_view, const Bus*>& buses) const;
+        svg::Document Render(const CatalogueReader& catalogue) const;
+
+        // Выводит карту, собранную из закэшированных кусков; после изменений справочника параллельно
+        // перерисовываются только затронутые маршруты и остановки. Вывод совпадает с Render(catalogue).Render(out)
+        void Render(const CatalogueReader& catalogue, std::ostream& out) const;
+
+        // Кодирует ту же раскладку карты в бинарный векторный тайл (см. tile.h)
+        std::string RenderTile(const CatalogueReader& catalogue) const;
+
+        // Сведения о построении раскладки карты (спроецированных координат остановок)
+        IndexBuildStats GetLayoutStats() const;
 
     private:
+        struct MapLayout;
+        struct FragmentCache;
+
+        // Возвращает раскладку для текущей версии справочника, пересчитывая её только после изменений
+        std::shared_ptr<const MapLayout> GetLayout(const CatalogueReader& catalogue) const;
+
+        void UpdateFragments(std::shared_ptr<const MapLayout> layout) const;
+
         RenderSettings render_settings_;
+        mutable std::mutex layout_mutex_;
+        mutable std::shared_ptr<const MapLayout> layout_;
+        mutable size_t layout_build_count_ = 0;
+        mutable std::chrono::nanoseconds layout_build_time_{};
+        mutable std::mutex fragments_mutex_;
+        mutable std::shared_ptr<FragmentCache> fragments_;
     };
 }
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "name_index.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+namespace transport {
+
+    namespace {
+        constexpr uint32_t DIRECT_SLOT = 0x80000000u;
+        constexpr uint32_t MAX_SEED_TRIES = 1u << 16;
+        constexpr int MAX_BUILD_ATTEMPTS = 16;
+        constexpr uint64_t GOLDEN = 0x9E3779B97F4A7C15ull;
+
+        // Финализатор splitmix64
+        uint64_t Mix(uint64_t x) {
+            x ^= x >> 30;
+            x *= 0xBF58476D1CE4E5B9ull;
+            x ^= x >> 27;
+            x *= 0x94D049BB133111EBull;
+            x ^= x >> 31;
+            return x;
+        }
+
+        uint64_t HashName(std::string_view name, uint64_t seed) {
+            uint64_t hash = Mix(seed ^ (name.size() * GOLDEN));
+            size_t i = 0;
+            for (; i + 8 <= name.size(); i += 8) {
+                uint64_t word;
+                std::memcpy(&word, name.data() + i, 8);
+                hash = Mix(hash ^ word);
+            }
+            if (i < name.size()) {
+                uint64_t tail = 0;
+                std::memcpy(&tail, name.data() + i, name.size() - i);
+                hash = Mix(hash ^ tail);
+            }
+            return hash;
+        }
+
+        // Отображает 32-битное значение на [0, range) умножением вместо деления
+        size_t Reduce(uint32_t value, size_t range) {
+            return size_t((uint64_t(value) * range) >> 32);
+        }
+
+        size_t GetBucket(uint64_t hash, size_t bucket_count) {
+            return Reduce(uint32_t(hash >> 32), bucket_count);
+        }
+
+        size_t GetSlot(uint64_t hash, uint32_t seed, size_t slot_count) {
+            return Reduce(uint32_t(Mix(hash + seed * GOLDEN) >> 32), slot_count);
+        }
+    }
+
+    PerfectNameIndex::PerfectNameIndex(const std::vector<std::optional<std::string_view>>& names) {
+        const size_t key_count = size_t(std::count_if(names.begin(), names.end(), [](const auto& name) {
+            return name.has_value();
+        }));
+        if (key_count == 0) {
+            return;
+        }
+        if (key_count >= DIRECT_SLOT) {
+            throw std::length_error("Too many names for PerfectNameIndex"s);
+        }
+
+        // Неудача почти всегда означает совпадение полных 64-битных хешей, которое лечится другим
+        // зерном; если совпадение держится при всех зёрнах, названия повторяются
+        for (int attempt = 0; attempt < MAX_BUILD_ATTEMPTS; ++attempt) {
+            hash_seed_ = Mix(GOLDEN * uint64_t(attempt + 1));
+            if (TryBuild(names, key_count)) {
+                return;
+            }
+        }
+        throw std::invalid_argument("Names for PerfectNameIndex are not unique"s);
+    }
+
+    bool PerfectNameIndex::TryBuild(const std::vector<std::optional<std::string_view>>& names, size_t key_count) {
+        struct Key {
+            uint64_t hash;
+            uint32_t id;
+        };
+
+        // В среднем по два названия на корзину: корзины-одиночки потом занимают оставшиеся ячейки напрямую
+        const size_t bucket_count = key_count / 2 + 1;
+        std::vector<Key> keys;
+        keys.reserve(key_count);
+        for (size_t id = 0; id < names.size(); ++id) {
+            if (names[id]) {
+                keys.push_back({HashName(*names[id], hash_seed_), uint32_t(id)});
+            }
+        }
+
+        // Раскладка названий по корзинам подсчётом
+        std::vector<uint32_t> bucket_offsets(bucket_count + 1, 0);
+        for (const Key& key : keys) {
+            ++bucket_offsets[GetBucket(key.hash, bucket_count) + 1];
+        }
+        for (size_t i = 0; i < bucket_count; ++i) {
+            bucket_offsets[i + 1] += bucket_offsets[i];
+        }
+        std::vector<Key> bucket_keys(key_count);
+        std::vector<uint32_t> cursors(bucket_offsets.begin(), bucket_offsets.end() - 1);
+        for (const Key& key : keys) {
+            bucket_keys[cursors[GetBucket(key.hash, bucket_count)]++] = key;
+        }
+
+        // Большие корзины размещаются первыми, пока в таблице много свободных ячеек
+        std::vector<uint32_t> bucket_order(bucket_count);
+        for (size_t i = 0; i < bucket_count; ++i) {
+            bucket_order[i] = uint32_t(i);
+        }
+        std::stable_sort(bucket_order.begin(), bucket_order.end(), [&bucket_offsets](uint32_t lhs, uint32_t rhs) {
+            return bucket_offsets[lhs + 1] - bucket_offsets[lhs] > bucket_offsets[rhs + 1] - bucket_offsets[rhs];
+        });
+
+        bucket_seeds_.assign(bucket_count, 0);
+        slots_.assign(key_count, {});
+        std::vector<bool> is_taken(key_count, false);
+        std::vector<size_t> bucket_slots;
+        size_t free_slot = 0;
+
+        for (const uint32_t bucket : bucket_order) {
+            const Key* first = bucket_keys.data() + bucket_offsets[bucket];
+            const Key* last = bucket_keys.data() + bucket_offsets[bucket + 1];
+            if (first == last) {
+                break;
+            }
+
+            if (last - first == 1) {
+                while (is_taken[free_slot]) {
+                    ++free_slot;
+                }
+                is_taken[free_slot] = true;
+                slots_[free_slot] = {uint32_t(first->hash), first->id};
+                bucket_seeds_[bucket] = DIRECT_SLOT | uint32_t(free_slot);
+                continue;
+            }
+
+            bool is_placed = false;
+            for (uint32_t seed = 1; seed < MAX_SEED_TRIES && !is_placed; ++seed) {
+                bucket_slots.clear();
+                for (const Key* key = first; key != last; ++key) {
+                    const size_t slot = GetSlot(key->hash, seed, key_count);
+                    if (is_taken[slot]) {
+                        break;
+                    }
+                    is_taken[slot] = true;
+                    bucket_slots.push_back(slot);
+                }
+
+                is_placed = bucket_slots.size() == size_t(last - first);
+                if (!is_placed) {
+                    for (const size_t slot : bucket_slots) {
+                        is_taken[slot] = false;
+                    }
+                    continue;
+                }
+
+                bucket_seeds_[bucket] = seed;
+                for (size_t i = 0; i < bucket_slots.size(); ++i) {
+                    slots_[bucket_slots[i]] = {uint32_t(first[i].hash), first[i].id};
+                }
+            }
+
+            if (!is_placed) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::optional<size_t> PerfectNameIndex::FindCandidate(std::string_view name) const {
+        return GetView().FindCandidate(name);
+    }
+
+    size_t PerfectNameIndex::size() const {
+        return slots_.size();
+    }
+
+    uint64_t PerfectNameIndex::GetHashSeed() const {
+        return hash_seed_;
+    }
+
+    const std::vector<uint32_t>& PerfectNameIndex::GetBucketSeeds() const {
+        return bucket_seeds_;
+    }
+
+    const std::vector<NameIndexSlot>& PerfectNameIndex::GetSlots() const {
+        return slots_;
+    }
+
+    NameIndexView PerfectNameIndex::GetView() const {
+        return {hash_seed_, bucket_seeds_.data(), bucket_seeds_.size(), slots_.data(), slots_.size()};
+    }
+
+    NameIndexView::NameIndexView(uint64_t hash_seed, const uint32_t* bucket_seeds, size_t bucket_count,
+                                 const NameIndexSlot* slots, size_t slot_count)
+        : hash_seed_(hash_seed)
+        , bucket_seeds_(bucket_seeds)
+        , bucket_count_(bucket_count)
+        , slots_(slots)
+        , slot_count_(slot_count) {
+    }
+
+    std::optional<size_t> NameIndexView::FindCandidate(std::string_view name) const {
+        if (slot_count_ == 0 || bucket_count_ == 0) {
+            return std::nullopt;
+        }
+
+        const uint64_t hash = HashName(name, hash_seed_);
+        const uint32_t seed = bucket_seeds_[GetBucket(hash, bucket_count_)];
+        if (seed == 0) {
+            return std::nullopt;
+        }
+
+        // Таблицы из файла могут быть испорчены, поэтому ячейка прямой корзины проверяется
+        const size_t slot = (seed & DIRECT_SLOT) ? size_t(seed & ~DIRECT_SLOT) : GetSlot(hash, seed, slot_count_);
+        if (slot >= slot_count_ || slots_[slot].fingerprint != uint32_t(hash)) {
+            return std::nullopt;
+        }
+        return slots_[slot].id;
+    }
+
+}
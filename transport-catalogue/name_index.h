@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace transport {
+
+    struct NameIndexSlot {
+        uint32_t fingerprint = 0;
+        uint32_t id = 0;
+    };
+
+    // Таблицы PerfectNameIndex без владения. Таблицы не содержат указателей, поэтому их можно записать
+    // в файл как есть и искать прямо по отображённой памяти
+    class NameIndexView {
+    public:
+        NameIndexView() = default;
+
+        NameIndexView(uint64_t hash_seed, const uint32_t* bucket_seeds, size_t bucket_count,
+                      const NameIndexSlot* slots, size_t slot_count);
+
+        std::optional<size_t> FindCandidate(std::string_view name) const;
+
+    private:
+        uint64_t hash_seed_ = 0;
+        const uint32_t* bucket_seeds_ = nullptr;
+        size_t bucket_count_ = 0;
+        const NameIndexSlot* slots_ = nullptr;
+        size_t slot_count_ = 0;
+    };
+
+    // Минимальная совершенная хеш-функция над неизменным набором названий (hash-and-displace).
+    // Названия разложены по корзинам, и для каждой корзины подобрано смещение, при котором её
+    // названия попадают в свободные ячейки таблицы. В ячейке лежат 32-битный отпечаток хеша и id,
+    // так что поиск — одно чтение смещения и одно чтение ячейки. Неизвестное название почти всегда
+    // отсекается по пустой корзине или отпечатку, не трогая строки; найденного кандидата
+    // вызывающий сверяет с настоящим названием
+    class PerfectNameIndex {
+    public:
+        PerfectNameIndex() = default;
+
+        // names[id] — название объекта id или nullopt для удалённого объекта, который не индексируется.
+        // Повторяющиеся названия — std::invalid_argument
+        explicit PerfectNameIndex(const std::vector<std::optional<std::string_view>>& names);
+
+        // id объекта, который может называться name, или nullopt, если такого названия точно нет
+        std::optional<size_t> FindCandidate(std::string_view name) const;
+
+        size_t size() const;
+
+        uint64_t GetHashSeed() const;
+        const std::vector<uint32_t>& GetBucketSeeds() const;
+        const std::vector<NameIndexSlot>& GetSlots() const;
+
+        NameIndexView GetView() const;
+
+    private:
+        bool TryBuild(const std::vector<std::optional<std::string_view>>& names, size_t key_count);
+
+        uint64_t hash_seed_ = 0;
+        // 0 — пустая корзина, DIRECT_SLOT | slot — корзина из одного названия, иначе смещение
+        std::vector<uint32_t> bucket_seeds_;
+        std::vector<NameIndexSlot> slots_;
+    };
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "task_scheduler.h"
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace transport
+{
+    // Делит [0, count) на куски по числу ядер и вызывает func(first, last) для каждого куска в своём потоке.
+    // Удобно, когда потоку нужно своё состояние на весь кусок. Исключение из func пробрасывается
+    // после завершения всех кусков. Внутри задачи TaskScheduler куски становятся его подзадачами
+    // и мельче, чтобы их разбирали освободившиеся рабочие потоки, а не новые
+    template <typename Func>
+    void ParallelForRanges(size_t count, Func func)
+    {
+        if (auto* scheduler = TaskScheduler::GetCurrent())
+        {
+            scheduler->ForEachChunk(count, scheduler->GetWorkerCount() * 4, std::function<void(size_t, size_t)>(func));
+            return;
+        }
+
+        const size_t chunk_count = std::max(1u, std::thread::hardware_concurrency());
+        const size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+        std::vector<std::future<void>> chunks;
+
+        for (size_t first = 0; first < count; first += chunk_size)
+        {
+            const size_t last = std::min(first + chunk_size, count);
+            chunks.push_back(std::async(std::launch::async, [first, last, &func] {
+                func(first, last);
+            }));
+        }
+
+        for (auto& chunk : chunks)
+        {
+            chunk.wait();
+        }
+
+        for (auto& chunk : chunks)
+        {
+            chunk.get();
+        }
+    }
+
+    // Вызывает func(i) для всех i из [0, count), разбивая диапазон на куски по числу ядер.
+    // Исключение из func пробрасывается после завершения всех кусков
+    template <typename Func>
+    void ParallelFor(size_t count, Func func)
+    {
+        ParallelForRanges(count, [&func](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i)
+            {
+                func(i);
+            }
+        });
+    }
+}
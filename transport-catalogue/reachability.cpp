@@ -0,0 +1,186 @@
+#include "reachability.h"
+#include "parallel.h"
+#include <algorithm>
+
+namespace transport {
+
+    TransferSearch::TransferSearch(const StopBusIncidence& incidence)
+        : incidence_(incidence)
+        , visited_stops_((incidence.GetStopCount() + 63) / 64, 0)
+        , frontier_stops_(visited_stops_.size(), 0)
+        , used_buses_((incidence.GetBusCount() + 63) / 64, 0) {
+    }
+
+    const std::vector<std::pair<uint32_t, int>>& TransferSearch::Run(uint32_t source_rank, int max_transfers) {
+        Search(source_rank, max_transfers, true);
+        return reached_;
+    }
+
+    size_t TransferSearch::Count(uint32_t source_rank, int max_transfers) {
+        return Search(source_rank, max_transfers, false);
+    }
+
+    size_t TransferSearch::Search(uint32_t source_rank, int max_transfers, bool collect) {
+        Clear();
+        used_bus_count_ = 0;
+        size_t count = 0;
+        visited_stops_[source_rank / 64] |= uint64_t(1) << (source_rank % 64);
+        touched_stop_words_.push_back(source_rank / 64);
+        frontier_.push_back(source_rank);
+        frontier_stops_[source_rank / 64] |= uint64_t(1) << (source_rank % 64);
+
+        // Когда достигнуты все остановки, дальнейшие раунды ничего не добавят
+        for (int transfers = 0; transfers <= max_transfers && !frontier_.empty()
+                                && count + 1 < incidence_.GetStopCount(); ++transfers) {
+            new_buses_.clear();
+            if (frontier_.size() > incidence_.GetBusCount() - used_bus_count_) {
+                PullBuses();
+            }
+            else {
+                PushBuses();
+            }
+
+            for (const uint32_t stop_rank : frontier_) {
+                frontier_stops_[stop_rank / 64] = 0;
+            }
+            frontier_.clear();
+
+            // Остановки последнего раунда дальше не расширяются, и без collect их достаточно посчитать
+            const bool enumerate = collect || transfers < max_transfers;
+            for (const uint32_t bus_rank : new_buses_) {
+                incidence_.GetBusStops(bus_rank).ForEachWord([&](uint32_t word_index, uint64_t word) {
+                    uint64_t& visited = visited_stops_[word_index];
+                    uint64_t fresh = word & ~visited;
+                    if (fresh == 0) {
+                        return;
+                    }
+                    if (visited == 0) {
+                        touched_stop_words_.push_back(word_index);
+                    }
+                    visited |= fresh;
+                    count += __builtin_popcountll(fresh);
+                    if (!enumerate) {
+                        return;
+                    }
+                    frontier_stops_[word_index] |= fresh;
+                    for (; fresh != 0; fresh &= fresh - 1) {
+                        const uint32_t stop_rank = word_index * 64 + __builtin_ctzll(fresh);
+                        frontier_.push_back(stop_rank);
+                        if (collect) {
+                            reached_.emplace_back(stop_rank, transfers);
+                        }
+                    }
+                });
+            }
+        }
+        return count;
+    }
+
+    void TransferSearch::PushBuses() {
+        for (const uint32_t stop_rank : frontier_) {
+            incidence_.GetStopBuses(stop_rank).ForEachWord([this](uint32_t word_index, uint64_t word) {
+                if (const uint64_t fresh = word & ~used_buses_[word_index]) {
+                    UseBuses(word_index, fresh);
+                }
+            });
+        }
+    }
+
+    void TransferSearch::PullBuses() {
+        const size_t bus_count = incidence_.GetBusCount();
+        for (uint32_t word_index = 0; word_index < used_buses_.size(); ++word_index) {
+            uint64_t unused = ~used_buses_[word_index];
+            if (word_index * 64 + 64 > bus_count) {
+                unused &= (uint64_t(1) << (bus_count % 64)) - 1;
+            }
+
+            uint64_t fresh = 0;
+            for (; unused != 0; unused &= unused - 1) {
+                const uint32_t bus_rank = word_index * 64 + __builtin_ctzll(unused);
+                if (incidence_.GetBusStops(bus_rank).Intersects(frontier_stops_)) {
+                    fresh |= unused & -unused;
+                }
+            }
+            if (fresh != 0) {
+                UseBuses(word_index, fresh);
+            }
+        }
+    }
+
+    void TransferSearch::UseBuses(uint32_t word_index, uint64_t buses) {
+        if (used_buses_[word_index] == 0) {
+            touched_bus_words_.push_back(word_index);
+        }
+        used_buses_[word_index] |= buses;
+        used_bus_count_ += __builtin_popcountll(buses);
+        for (; buses != 0; buses &= buses - 1) {
+            new_buses_.push_back(word_index * 64 + __builtin_ctzll(buses));
+        }
+    }
+
+    void TransferSearch::Clear() {
+        for (const uint32_t word_index : touched_stop_words_) {
+            visited_stops_[word_index] = 0;
+        }
+        for (const uint32_t word_index : touched_bus_words_) {
+            used_buses_[word_index] = 0;
+        }
+        for (const uint32_t stop_rank : frontier_) {
+            frontier_stops_[stop_rank / 64] = 0;
+        }
+        touched_stop_words_.clear();
+        touched_bus_words_.clear();
+        frontier_.clear();
+        reached_.clear();
+    }
+
+    namespace {
+
+        std::vector<ReachableStop> FindReachableStops(const StopBusIncidence& incidence, TransferSearch& search,
+                                                      size_t stop_id, int max_transfers) {
+            std::vector<ReachableStop> result;
+            const uint32_t stop_rank = incidence.GetStopRank(stop_id);
+            if (stop_rank == StopBusIncidence::NO_RANK) {
+                return result;
+            }
+
+            auto reached = search.Run(stop_rank, max_transfers);
+            std::sort(reached.begin(), reached.end());
+            result.reserve(reached.size());
+            for (const auto& [rank, transfers] : reached) {
+                result.push_back({incidence.GetStopId(rank), transfers});
+            }
+            return result;
+        }
+
+    }
+
+    std::vector<ReachableStop> FindReachableStops(const StopBusIncidence& incidence, size_t stop_id, int max_transfers) {
+        TransferSearch search(incidence);
+        return FindReachableStops(incidence, search, stop_id, max_transfers);
+    }
+
+    std::vector<std::vector<ReachableStop>> FindReachableStops(const StopBusIncidence& incidence,
+                                                               const std::vector<size_t>& stop_ids, int max_transfers) {
+        std::vector<std::vector<ReachableStop>> result(stop_ids.size());
+        ParallelForRanges(stop_ids.size(), [&](size_t first, size_t last) {
+            TransferSearch search(incidence);
+            for (size_t i = first; i < last; ++i) {
+                result[i] = FindReachableStops(incidence, search, stop_ids[i], max_transfers);
+            }
+        });
+        return result;
+    }
+
+    std::vector<size_t> CountReachableStops(const StopBusIncidence& incidence, int max_transfers) {
+        std::vector<size_t> result(incidence.GetStopCount());
+        ParallelForRanges(result.size(), [&](size_t first, size_t last) {
+            TransferSearch search(incidence);
+            for (size_t rank = first; rank < last; ++rank) {
+                result[rank] = search.Count(uint32_t(rank), max_transfers);
+            }
+        });
+        return result;
+    }
+
+}
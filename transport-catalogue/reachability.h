@@ -0,0 +1,71 @@
+#pragma once
+#include "incidence.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace transport {
+
+    struct ReachableStop {
+        size_t stop_id = 0;
+        int transfers = 0;
+    };
+
+    // Поиск в ширину по остановкам и автобусам с ограничением числа пересадок. Раунд с номером k
+    // пересаживает на ещё не использованные автобусы с остановок, достигнутых в раунде k - 1, и отмечает
+    // их новые остановки. Фронт, посещённые остановки и использованные автобусы хранятся плотными
+    // битовыми картами, а слова разреженных карт матрицы инцидентности обрабатываются целиком: за одну
+    // операцию отсеиваются до 64 уже известных остановок или автобусов. Пока фронт мал, автобусы
+    // перебираются от его остановок; когда он больше числа неиспользованных автобусов, наоборот,
+    // каждый такой автобус проверяется на пересечение с фронтом. Состояние переиспользуется между
+    // запусками и очищается только по затронутым словам, поэтому серия запусков не платит за размер сети
+    class TransferSearch {
+    public:
+        explicit TransferSearch(const StopBusIncidence& incidence);
+
+        // Остановки, достижимые из остановки с рангом source_rank не более чем с max_transfers
+        // пересадками, кроме неё самой, в порядке обнаружения: (ранг, число пересадок)
+        const std::vector<std::pair<uint32_t, int>>& Run(uint32_t source_rank, int max_transfers);
+
+        // Только число достижимых остановок: новые биты считаются popcount без перечисления
+        size_t Count(uint32_t source_rank, int max_transfers);
+
+    private:
+        size_t Search(uint32_t source_rank, int max_transfers, bool collect);
+
+        // Новые автобусы раунда от остановок фронта
+        void PushBuses();
+
+        // Новые автобусы раунда среди неиспользованных, проходящих через фронт
+        void PullBuses();
+
+        void UseBuses(uint32_t word_index, uint64_t buses);
+
+        void Clear();
+
+        const StopBusIncidence& incidence_;
+        std::vector<uint64_t> visited_stops_;
+        std::vector<uint64_t> frontier_stops_;
+        std::vector<uint64_t> used_buses_;
+        size_t used_bus_count_ = 0;
+        std::vector<uint32_t> touched_stop_words_;
+        std::vector<uint32_t> touched_bus_words_;
+        std::vector<uint32_t> frontier_;
+        std::vector<uint32_t> new_buses_;
+        std::vector<std::pair<uint32_t, int>> reached_;
+    };
+
+    // Остановки, достижимые из stop_id не более чем с max_transfers пересадками, в порядке названий.
+    // Для остановки без автобусов результат пуст
+    std::vector<ReachableStop> FindReachableStops(const StopBusIncidence& incidence, size_t stop_id, int max_transfers);
+
+    // То же для набора остановок; источники обрабатываются параллельно
+    std::vector<std::vector<ReachableStop>> FindReachableStops(const StopBusIncidence& incidence,
+                                                               const std::vector<size_t>& stop_ids, int max_transfers);
+
+    // Число достижимых остановок для каждой обслуживаемой остановки, по рангам. Все источники
+    // обрабатываются параллельно, у каждого потока своё состояние поиска
+    std::vector<size_t> CountReachableStops(const StopBusIncidence& incidence, int max_transfers);
+
+}
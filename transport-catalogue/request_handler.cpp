@@ -1,12 +1,19 @@
 #include "request_handler.h"
+#include <cstdint>
+#include <stdexcept>
 
 using namespace transport;
 
 //RequestHandler::RequestHandler(Catalogue& catalogue)
 //    : catalogue_(catalogue) {}
 
-RequestHandler::RequestHandler(Catalogue& catalogue, MapRenderer& renderer)
-    : catalogue_(catalogue), renderer_(renderer)
+RequestHandler::RequestHandler(VersionedCatalogue& catalogue, MapRenderer& renderer)
+    : versioned_catalogue_(&catalogue), catalogue_version_(catalogue.Get()), reader_(catalogue_version_.get()),
+      renderer_(renderer)
+{}
+
+RequestHandler::RequestHandler(const CatalogueReader& catalogue, MapRenderer& renderer)
+    : reader_(&catalogue), renderer_(renderer)
 {}
 
 void RequestHandler::AddStopRequest(std::string name, Coordinates coordinates, std::map<std::string_view, int> road_distances)
@@ -14,48 +21,332 @@ void RequestHandler::AddStopRequest(std::string name, Coordinates coordinates, s
     stop_update_requests_.push_back( {std::move(name), std::move(coordinates), std::move(road_distances)});
 }
 
-void RequestHandler::AddBusRequest(std::string name, std::vector<std::string_view> stops, bool is_roundtrip)
+void RequestHandler::AddBusRequest(std::string name, std::vector<std::string_view> stops, bool is_roundtrip,
+                                   std::vector<double> departures)
 {
-    bus_update_requests_.push_back({std::move(name), is_roundtrip, std::move(stops)});
+    bus_update_requests_.push_back({std::move(name), is_roundtrip, std::move(stops), std::move(departures)});
 }
 
 void RequestHandler::UpdateCatalogue()
 {
-    for (const auto& request : stop_update_requests_)
+    using namespace std::literals;
+
+    if (!versioned_catalogue_)
     {
-        catalogue_.AddStop(request.name, request.coordinates);
+        throw std::logic_error("Base requests can't be applied to a read-only catalogue"s);
     }
 
-    for (const auto& request : stop_update_requests_)
-    {
-        for (const auto& [stop_name_to, distance] : request.road_distances)
+    versioned_catalogue_->Update([this](Catalogue& catalogue) {
+        size_t distance_count = 0;
+        for (const auto& request : stop_update_requests_)
         {
-            catalogue_.SetStopsDistance(request.name, stop_name_to, distance);
+            distance_count += request.road_distances.size();
         }
-    }
+        catalogue.Reserve(stop_update_requests_.size(), distance_count);
 
-    for (const auto& request : bus_update_requests_)
+        for (const auto& request : stop_update_requests_)
+        {
+            catalogue.AddStop(request.name, request.coordinates);
+        }
+
+        for (const auto& request : stop_update_requests_)
+        {
+            for (const auto& [stop_name_to, distance] : request.road_distances)
+            {
+                catalogue.SetStopsDistance(request.name, stop_name_to, distance);
+            }
+        }
+
+        std::vector<Catalogue::BusInput> buses;
+        buses.reserve(bus_update_requests_.size());
+        for (auto& request : bus_update_requests_)
+        {
+            buses.push_back({std::move(request.name), std::move(request.stops), request.is_roundtrip,
+                             std::move(request.departures)});
+        }
+        catalogue.AddBuses(buses);
+        // После загрузки набор названий не меняется, пока не придут изменения
+        catalogue.Freeze();
+    });
+    PublishVersion();
+
+    stop_update_requests_.clear();
+    bus_update_requests_.clear();
+}
+
+DeltaReport RequestHandler::ApplyDelta(const CatalogueDelta& delta)
+{
+    using namespace std::literals;
+
+    if (!versioned_catalogue_)
     {
-        catalogue_.AddBus(request.name, request.stops, request.is_roundtrip);
+        throw std::logic_error("Delta requests can't be applied to a read-only catalogue"s);
     }
+
+    DeltaReport report;
+    versioned_catalogue_->Update([&delta, &report](Catalogue& catalogue) {
+        report = catalogue.ApplyDelta(delta);
+    });
+    PublishVersion();
+    return report;
+}
+
+std::shared_lock<std::shared_mutex> RequestHandler::LockVersion() const
+{
+    return std::shared_lock(version_mutex_);
 }
 
 std::optional<StopInfo> RequestHandler::GetStopInfo(std::string_view name_view) const
 {
-    return catalogue_.FindStop(name_view);
+    return reader_->FindStop(name_view);
 }
 
 std::optional<BusInfo> RequestHandler::GetBusInfo(std::string_view name_view) const
 {
-    return catalogue_.FindBus(name_view);
+    return reader_->FindBus(name_view);
+}
+
+const NetworkStats& RequestHandler::GetNetworkStats() const
+{
+    return reader_->GetNetworkStats();
+}
+
+std::optional<std::vector<std::string_view>> RequestHandler::GetDirectBuses(std::string_view stop_name_from,
+                                                                           std::string_view stop_name_to) const
+{
+    const auto stop_from = reader_->FindStop(stop_name_from);
+    const auto stop_to = reader_->FindStop(stop_name_to);
+
+    if (!stop_from || !stop_to)
+    {
+        return std::nullopt;
+    }
+
+    return reader_->GetIncidence().GetDirectBuses(stop_from->id, stop_to->id);
+}
+
+std::optional<std::vector<std::string_view>> RequestHandler::GetCoServedStops(std::string_view stop_name) const
+{
+    const auto stop = reader_->FindStop(stop_name);
+
+    if (!stop)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<std::string_view> stop_names;
+    for (const size_t stop_id : reader_->GetIncidence().GetCoServedStops(stop->id))
+    {
+        stop_names.push_back(reader_->GetStopName(stop_id));
+    }
+    return stop_names;
+}
+
+std::optional<std::vector<std::pair<std::string_view, int>>> RequestHandler::GetReachableStops(std::string_view stop_name,
+                                                                                               int max_transfers) const
+{
+    auto result = GetReachableStops(std::vector<std::string_view>{stop_name}, max_transfers);
+    return std::move(result.front());
+}
+
+std::vector<std::optional<std::vector<std::pair<std::string_view, int>>>> RequestHandler::GetReachableStops(
+        const std::vector<std::string_view>& stop_names, int max_transfers) const
+{
+    std::vector<size_t> stop_ids;
+    std::vector<bool> found;
+    stop_ids.reserve(stop_names.size());
+    found.reserve(stop_names.size());
+
+    for (const auto stop_name : stop_names)
+    {
+        const auto stop = reader_->FindStop(stop_name);
+        stop_ids.push_back(stop ? stop->id : SIZE_MAX);
+        found.push_back(stop.has_value());
+    }
+
+    const auto reachable = FindReachableStops(reader_->GetIncidence(), stop_ids, max_transfers);
+    std::vector<std::optional<std::vector<std::pair<std::string_view, int>>>> result(stop_names.size());
+
+    for (size_t i = 0; i < stop_names.size(); ++i)
+    {
+        if (!found[i])
+        {
+            continue;
+        }
+
+        auto& stops = result[i].emplace();
+        stops.reserve(reachable[i].size());
+        for (const auto& stop : reachable[i])
+        {
+            stops.emplace_back(reader_->GetStopName(stop.stop_id), stop.transfers);
+        }
+    }
+    return result;
+}
+
+std::vector<std::pair<std::string_view, size_t>> RequestHandler::GetReachabilityCoverage(int max_transfers) const
+{
+    const auto& incidence = reader_->GetIncidence();
+    const auto counts = CountReachableStops(incidence, max_transfers);
+    std::vector<std::pair<std::string_view, size_t>> result;
+    result.reserve(counts.size());
+
+    for (size_t rank = 0; rank < counts.size(); ++rank)
+    {
+        result.emplace_back(reader_->GetStopName(incidence.GetStopId(uint32_t(rank))), counts[rank]);
+    }
+    return result;
+}
+
+std::optional<std::vector<std::pair<std::string_view, double>>> RequestHandler::GetIsochrone(std::string_view stop_name,
+                                                                                             double time_limit) const
+{
+    const auto stop = reader_->FindStop(stop_name);
+
+    if (!stop)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<std::pair<std::string_view, double>> stops;
+    for (const auto& [stop_id, time] : router_.FindIsochrone(*reader_, stop->id, time_limit))
+    {
+        stops.emplace_back(reader_->GetStopName(stop_id), time);
+    }
+    return stops;
+}
+
+bool RequestHandler::ComputeTravelTimes(const std::vector<std::string_view>& sources,
+                                        const std::vector<std::string_view>& targets,
+                                        const std::function<void(size_t, std::vector<double>)>& on_row) const
+{
+    auto find_stop_ids = [this](const std::vector<std::string_view>& stop_names) {
+        std::vector<size_t> stop_ids;
+        stop_ids.reserve(stop_names.size());
+        for (const auto stop_name : stop_names)
+        {
+            const auto stop = reader_->FindStop(stop_name);
+            if (!stop)
+            {
+                return std::optional<std::vector<size_t>>{};
+            }
+            stop_ids.push_back(stop->id);
+        }
+        return std::optional{std::move(stop_ids)};
+    };
+
+    const auto source_ids = find_stop_ids(sources);
+    const auto target_ids = find_stop_ids(targets);
+
+    if (!source_ids || !target_ids)
+    {
+        return false;
+    }
+
+    router_.ComputeTravelTimes(*reader_, *source_ids, *target_ids, on_row);
+    return true;
+}
+
+std::optional<std::vector<Journey>> RequestHandler::GetJourneys(const JourneyRequest& request, int max_transfers) const
+{
+    auto result = GetJourneys(std::vector<JourneyRequest>{request}, max_transfers);
+    return std::move(result.front());
+}
+
+std::vector<std::optional<std::vector<Journey>>> RequestHandler::GetJourneys(const std::vector<JourneyRequest>& requests,
+                                                                             int max_transfers) const
+{
+    std::vector<JourneyQuery> queries;
+    std::vector<size_t> query_indexes;
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        const auto stop_from = reader_->FindStop(requests[i].from);
+        const auto stop_to = reader_->FindStop(requests[i].to);
+        if (stop_from && stop_to)
+        {
+            queries.push_back({stop_from->id, stop_to->id, requests[i].departure_time});
+            query_indexes.push_back(i);
+        }
+    }
+
+    auto journeys = journey_planner_.FindJourneys(*reader_, queries, max_transfers);
+    std::vector<std::optional<std::vector<Journey>>> result(requests.size());
+
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        result[query_indexes[i]] = std::move(journeys[i]);
+    }
+    return result;
 }
 
 void RequestHandler::SetRendererSettings(RenderSettings render_settings)
 {
     renderer_.SetRenderSettings(std::move(render_settings));
+    response_cache_.Clear();
+}
+
+void RequestHandler::SetRoutingSettings(RoutingSettings routing_settings)
+{
+    journey_planner_.SetRoutingSettings(routing_settings);
+    router_.SetRoutingSettings(std::move(routing_settings));
+    response_cache_.Clear();
+}
+
+IndexBuildStats RequestHandler::GetRoutingGraphStats() const
+{
+    return router_.GetGraphStats();
+}
+
+IndexBuildStats RequestHandler::GetTimetableStats() const
+{
+    return journey_planner_.GetTimetableStats();
+}
+
+std::shared_ptr<const CachedResponse> RequestHandler::FindCachedResponse(std::string_view request_key) const
+{
+    return response_cache_.Find(MakeCacheKey(request_key));
+}
+
+void RequestHandler::CacheResponse(std::string_view request_key, CachedResponse response) const
+{
+    response_cache_.Insert(MakeCacheKey(request_key), std::move(response));
+}
+
+void RequestHandler::SetResponseCacheSettings(ResponseCacheSettings settings)
+{
+    response_cache_.SetSettings(settings);
+}
+
+ResponseCacheStats RequestHandler::GetResponseCacheStats() const
+{
+    return response_cache_.GetStats();
+}
+
+// Ответы прежних версий справочника больше не находятся и со временем вытесняются
+std::string RequestHandler::MakeCacheKey(std::string_view request_key) const
+{
+    std::string key = std::to_string(reader_->GetVersion());
+    key += ':';
+    key += request_key;
+    return key;
+}
+
+// Новая версия собрана, пока шли запросы к прежней; переключение ждёт только уже начатые ответы
+void RequestHandler::PublishVersion()
+{
+    auto version = versioned_catalogue_->Get();
+    std::unique_lock lock(version_mutex_);
+    reader_ = version.get();
+    catalogue_version_.swap(version);
+}
+
+void RequestHandler::RenderMap(std::ostream& out) const
+{
+    renderer_.Render(*reader_, out);
 }
 
-svg::Document RequestHandler::RenderMap() const
+std::string RequestHandler::RenderMapTile() const
 {
-    return renderer_.Render(catalogue_.GetBuses());
+    return renderer_.RenderTile(*reader_);
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #pragma once
 #include "transport_catalogue.h"
 #include "map_renderer.h"
+#include "reachability.h"
+#include "transport_router.h"
+#include "journey_planner.h"
+#include "response_cache.h"
 #include "geo.h"
 #include "svg.h"
+#include <functional>
 #include <vector>
 #include <map>
+#include <memory>
+#include <shared_mutex>
 #include <string>
 #include <string_view>
 #include <optional>
@@ -16,21 +23,103 @@ namespace transport
     public:
         //explicit RequestHandler(Catalogue& catalogue);
 
-        RequestHandler(Catalogue& catalogue, MapRenderer& renderer);
+        // Запросы отвечаются по опубликованной версии справочника. UpdateCatalogue и ApplyDelta собирают
+        // следующую версию через VersionedCatalogue::Update, не мешая запросам, и переключают на неё обработчик
+        RequestHandler(VersionedCatalogue& catalogue, MapRenderer& renderer);
+
+        // Обработчик только для чтения: UpdateCatalogue и ApplyDelta для него бросают std::logic_error
+        RequestHandler(const CatalogueReader& catalogue, MapRenderer& renderer);
 
         void AddStopRequest(std::string name, Coordinates coordinates, std::map<std::string_view, int> road_distances);
 
-        void AddBusRequest(std::string name, std::vector<std::string_view> stops, bool is_roundtrip);
+        // departures — отправления рейсов с начальной остановки в минутах от начала суток, если есть расписание
+        void AddBusRequest(std::string name, std::vector<std::string_view> stops, bool is_roundtrip,
+                           std::vector<double> departures = {});
 
         void UpdateCatalogue();
 
+        // Применяет изменения к уже построенному справочнику; для обработчика только для чтения
+        // бросает std::logic_error
+        DeltaReport ApplyDelta(const CatalogueDelta& delta);
+
+        // Ответы ссылаются на версию справочника, по которой вычислены. Пока блокировка жива, обработчик
+        // не переключится на новую версию, поэтому запросы и использование ответов идут под ней.
+        // Повторно в том же потоке не берётся
+        std::shared_lock<std::shared_mutex> LockVersion() const;
+
         std::optional<StopInfo> GetStopInfo(std::string_view name_view) const;
 
         std::optional<BusInfo> GetBusInfo(std::string_view name_view) const;
 
+        // Рейтинги и итоги сети для текущей версии справочника
+        const NetworkStats& GetNetworkStats() const;
+
+        // Автобусы, идущие без пересадок между двумя остановками, или nullopt, если остановки нет
+        std::optional<std::vector<std::string_view>> GetDirectBuses(std::string_view stop_name_from,
+                                                                    std::string_view stop_name_to) const;
+
+        // Остановки, куда можно доехать без пересадок, или nullopt, если остановки нет
+        std::optional<std::vector<std::string_view>> GetCoServedStops(std::string_view stop_name) const;
+
+        // Остановки, достижимые не более чем с max_transfers пересадками, с числом пересадок,
+        // в порядке названий, или nullopt, если остановки нет
+        std::optional<std::vector<std::pair<std::string_view, int>>> GetReachableStops(std::string_view stop_name,
+                                                                                       int max_transfers) const;
+
+        // То же для набора остановок; источники обрабатываются параллельно
+        std::vector<std::optional<std::vector<std::pair<std::string_view, int>>>> GetReachableStops(
+                const std::vector<std::string_view>& stop_names, int max_transfers) const;
+
+        // Число достижимых остановок для каждой остановки с автобусами, в порядке названий
+        std::vector<std::pair<std::string_view, size_t>> GetReachabilityCoverage(int max_transfers) const;
+
+        // Остановки, до которых можно доехать не дольше чем за time_limit минут, со временем в пути,
+        // или nullopt, если остановки нет
+        std::optional<std::vector<std::pair<std::string_view, double>>> GetIsochrone(std::string_view stop_name,
+                                                                                     double time_limit) const;
+
+        // Матрица времени в пути между остановками: on_row(i, times) вызывается из рабочих потоков по мере
+        // готовности строк; times[j] — время от sources[i] до targets[j] или бесконечность.
+        // Возвращает false, если какой-то остановки нет
+        bool ComputeTravelTimes(const std::vector<std::string_view>& sources, const std::vector<std::string_view>& targets,
+                                const std::function<void(size_t, std::vector<double>)>& on_row) const;
+
+        struct JourneyRequest
+        {
+            std::string_view from;
+            std::string_view to;
+            double departure_time = 0.0;
+        };
+
+        // Парето-оптимальные по времени прибытия и числу пересадок поездки по расписаниям,
+        // или nullopt, если остановки нет
+        std::optional<std::vector<Journey>> GetJourneys(const JourneyRequest& request, int max_transfers) const;
+
+        // То же для набора запросов; запросы обрабатываются параллельно
+        std::vector<std::optional<std::vector<Journey>>> GetJourneys(const std::vector<JourneyRequest>& requests,
+                                                                     int max_transfers) const;
+
         void SetRendererSettings(RenderSettings render_settings);
 
-        svg::Document RenderMap() const;
+        void SetRoutingSettings(RoutingSettings routing_settings);
+
+        IndexBuildStats GetRoutingGraphStats() const;
+
+        IndexBuildStats GetTimetableStats() const;
+
+        // Готовый ответ на запрос с нормализованными параметрами request_key для текущей версии
+        // справочника или nullptr. Смена настроек отрисовки или маршрутизации очищает кэш
+        std::shared_ptr<const CachedResponse> FindCachedResponse(std::string_view request_key) const;
+
+        void CacheResponse(std::string_view request_key, CachedResponse response) const;
+
+        void SetResponseCacheSettings(ResponseCacheSettings settings);
+
+        ResponseCacheStats GetResponseCacheStats() const;
+
+        void RenderMap(std::ostream& out) const;
+
+        std::string RenderMapTile() const;
 
     private:
         struct StopUpdateRequest
@@ -45,10 +134,22 @@ namespace transport
             std::string name;
             bool is_roundtrip = false;
             std::vector<std::string_view> stops;
+            std::vector<double> departures;
         };
 
-        Catalogue& catalogue_;
+        std::string MakeCacheKey(std::string_view request_key) const;
+
+        void PublishVersion();
+
+        VersionedCatalogue* versioned_catalogue_ = nullptr;
+        // Версия, по которой отвечают запросы; меняется под исключительной блокировкой version_mutex_
+        std::shared_ptr<const Catalogue> catalogue_version_;
+        const CatalogueReader* reader_ = nullptr;
+        mutable std::shared_mutex version_mutex_;
         MapRenderer& renderer_;
+        TransportRouter router_;
+        JourneyPlanner journey_planner_;
+        mutable ResponseCache response_cache_;
         std::deque<StopUpdateRequest> stop_update_requests_;
         std::deque<BusUpdateRequest> bus_update_requests_;
     };
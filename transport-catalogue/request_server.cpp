@@ -0,0 +1,608 @@
+#include "request_server.h"
+#include "json.h"
+#include "json_reader.h"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace transport;
+using namespace std::literals;
+
+namespace
+{
+    // Идентификаторы в epoll для служебных дескрипторов; соединения нумеруются после них
+    const uint64_t LISTEN_ID = 0;
+    const uint64_t WAKE_ID = 1;
+    const uint64_t SIGNAL_ID = 2;
+    const uint64_t FIRST_CONNECTION_ID = 3;
+
+    const size_t MAX_FRAME_SIZE = size_t(64) << 20;
+    const size_t READ_BUFFER_SIZE = 64 << 10;
+    const int MAX_EVENTS = 64;
+
+    // Пока у соединения столько запросов без отправленного ответа или столько неотправленных байтов,
+    // из него ничего не читается
+    const uint64_t MAX_PIPELINED_REQUESTS = 64;
+    const size_t MAX_PENDING_OUTPUT = size_t(16) << 20;
+
+    std::system_error MakeSystemError(const char* what)
+    {
+        return std::system_error(errno, std::generic_category(), what);
+    }
+
+    struct SocketAddress
+    {
+        sockaddr_storage storage{};
+        socklen_t size = 0;
+        std::string unix_path;
+    };
+
+    SocketAddress ParseAddress(std::string_view address)
+    {
+        SocketAddress result;
+
+        if (address.substr(0, 5) == "unix:"sv)
+        {
+            const std::string_view path = address.substr(5);
+            auto& unix_address = reinterpret_cast<sockaddr_un&>(result.storage);
+            if (path.empty() || path.size() >= sizeof(unix_address.sun_path))
+            {
+                throw std::invalid_argument("Invalid socket path: "s + std::string(path));
+            }
+            unix_address.sun_family = AF_UNIX;
+            std::copy(path.begin(), path.end(), unix_address.sun_path);
+            result.size = sizeof(unix_address);
+            result.unix_path = std::string(path);
+            return result;
+        }
+
+        if (address.substr(0, 4) == "tcp:"sv)
+        {
+            const std::string port_text(address.substr(4));
+            size_t parsed = 0;
+            int port = -1;
+            try
+            {
+                port = std::stoi(port_text, &parsed);
+            }
+            catch (const std::logic_error&)
+            {
+            }
+            if (parsed != port_text.size() || port <= 0 || port > 65535)
+            {
+                throw std::invalid_argument("Invalid port: "s + port_text);
+            }
+            auto& inet_address = reinterpret_cast<sockaddr_in&>(result.storage);
+            inet_address.sin_family = AF_INET;
+            inet_address.sin_port = htons(static_cast<uint16_t>(port));
+            inet_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            result.size = sizeof(inet_address);
+            return result;
+        }
+
+        throw std::invalid_argument("Invalid address: "s + std::string(address));
+    }
+
+    // Ответы на небольшие запросы не должны ждать, пока наберётся полный TCP-сегмент
+    void DisableDelay(int fd, const SocketAddress& address)
+    {
+        if (address.storage.ss_family == AF_INET)
+        {
+            const int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+    }
+
+    std::string AnswerRequest(const RequestHandler& request_handler, const std::string& request)
+    {
+        std::istringstream input(request);
+        std::ostringstream output;
+        try
+        {
+            AnswerStatRequests(request_handler, input, output);
+        }
+        catch (...)
+        {
+            // Ответ на ошибочный документ — объект вместо массива
+            output.str({});
+            json::Print(json::Document(json::Node::Object{{"error_message"s, json::GetCurrentErrorMessage()}}), output);
+        }
+        return output.str();
+    }
+}
+
+std::string transport::MakeFrame(std::string_view payload)
+{
+    std::string frame = std::to_string(payload.size());
+    frame.reserve(frame.size() + 1 + payload.size());
+    frame += '\n';
+    frame += payload;
+    return frame;
+}
+
+size_t transport::FindFrame(std::string_view buffer, std::string_view& payload, size_t max_size)
+{
+    // Заголовок длиннее, чем число из 20 цифр, — уже не заголовок
+    const size_t header_end = buffer.find('\n');
+    if (header_end == std::string_view::npos)
+    {
+        if (buffer.size() > 20)
+        {
+            throw std::invalid_argument("Invalid frame header");
+        }
+        return 0;
+    }
+    if (header_end == 0 || header_end > 20)
+    {
+        throw std::invalid_argument("Invalid frame header");
+    }
+
+    size_t size = 0;
+    for (const char c : buffer.substr(0, header_end))
+    {
+        if (c < '0' || c > '9' || size > (max_size - (c - '0')) / 10)
+        {
+            throw std::invalid_argument("Invalid frame header");
+        }
+        size = size * 10 + (c - '0');
+    }
+
+    if (buffer.size() - header_end - 1 < size)
+    {
+        return 0;
+    }
+    payload = buffer.substr(header_end + 1, size);
+    return header_end + 1 + size;
+}
+
+int transport::ConnectSocket(std::string_view address)
+{
+    const SocketAddress socket_address = ParseAddress(address);
+    const int fd = socket(socket_address.storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        throw MakeSystemError("socket");
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&socket_address.storage), socket_address.size) < 0)
+    {
+        const auto error = MakeSystemError("connect");
+        close(fd);
+        throw error;
+    }
+    DisableDelay(fd, socket_address);
+    return fd;
+}
+
+RequestServer::RequestServer(const RequestHandler& request_handler, TaskScheduler& scheduler)
+    : request_handler_(request_handler)
+    , scheduler_(scheduler)
+    , next_connection_id_(FIRST_CONNECTION_ID)
+{
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0)
+    {
+        throw MakeSystemError("epoll_create1");
+    }
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0)
+    {
+        const auto error = MakeSystemError("eventfd");
+        close(epoll_fd_);
+        throw error;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_ID;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    signal_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd_ >= 0)
+    {
+        event.data.u64 = SIGNAL_ID;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, signal_fd_, &event);
+    }
+}
+
+RequestServer::~RequestServer()
+{
+    for (const auto& [id, connection] : connections_)
+    {
+        close(connection.fd);
+    }
+    for (const int fd : {listen_fd_, signal_fd_, wake_fd_, epoll_fd_})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    if (!unix_path_.empty())
+    {
+        unlink(unix_path_.c_str());
+    }
+}
+
+void RequestServer::Listen(std::string_view address)
+{
+    const SocketAddress socket_address = ParseAddress(address);
+
+    // Сокет, оставшийся от прошлого запуска, мешает bind; другие файлы не трогаются
+    struct stat file_stat{};
+    if (!socket_address.unix_path.empty() && stat(socket_address.unix_path.c_str(), &file_stat) == 0
+        && S_ISSOCK(file_stat.st_mode))
+    {
+        unlink(socket_address.unix_path.c_str());
+    }
+
+    const int fd = socket(socket_address.storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        throw MakeSystemError("socket");
+    }
+    const int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&socket_address.storage), socket_address.size) < 0
+        || listen(fd, SOMAXCONN) < 0)
+    {
+        const auto error = MakeSystemError("listen");
+        close(fd);
+        throw error;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_ID;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        const auto error = MakeSystemError("epoll_ctl");
+        close(fd);
+        throw error;
+    }
+
+    if (listen_fd_ >= 0)
+    {
+        close(listen_fd_);
+    }
+    listen_fd_ = fd;
+    is_tcp_ = socket_address.storage.ss_family == AF_INET;
+    unix_path_ = socket_address.unix_path;
+}
+
+void RequestServer::Run()
+{
+    epoll_event events[MAX_EVENTS];
+
+    while (!is_stopping_)
+    {
+        const int event_count = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+        if (event_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw MakeSystemError("epoll_wait");
+        }
+
+        for (int i = 0; i < event_count; ++i)
+        {
+            const uint64_t id = events[i].data.u64;
+            if (id == LISTEN_ID)
+            {
+                AcceptConnections();
+            }
+            else if (id == WAKE_ID)
+            {
+                uint64_t value = 0;
+                while (read(wake_fd_, &value, sizeof(value)) > 0)
+                {
+                }
+                DrainCompletions();
+            }
+            else if (id == SIGNAL_ID)
+            {
+                signalfd_siginfo info{};
+                while (read(signal_fd_, &info, sizeof(info)) > 0)
+                {
+                }
+                is_stopping_ = true;
+            }
+            else
+            {
+                // Соединение могло быть закрыто при обработке предыдущего события
+                ResumeConnection(id, events[i].events);
+            }
+        }
+    }
+
+    // Задачи ссылаются на сервер, поэтому он не может завершиться раньше них
+    std::unique_lock lock(completion_mutex_);
+    all_completed_.wait(lock, [this] {
+        return running_count_ == 0;
+    });
+    completions_.clear();
+}
+
+void RequestServer::Stop()
+{
+    is_stopping_ = true;
+    const uint64_t value = 1;
+    [[maybe_unused]] const auto written = write(wake_fd_, &value, sizeof(value));
+}
+
+RequestServerStats RequestServer::GetStats() const
+{
+    std::lock_guard guard(completion_mutex_);
+    return stats_;
+}
+
+void RequestServer::AcceptConnections()
+{
+    while (true)
+    {
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            // EAGAIN — очередь пуста; остальные ошибки, например нехватка дескрипторов, не должны
+            // останавливать сервер, соединение подождёт в очереди
+            return;
+        }
+
+        if (is_tcp_)
+        {
+            const int enable = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+
+        const uint64_t id = next_connection_id_++;
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            close(fd);
+            continue;
+        }
+
+        auto& connection = connections_[id];
+        connection.fd = fd;
+        connection.events = EPOLLIN;
+        connection.task = ServeConnection(id, connection);
+        {
+            std::lock_guard guard(completion_mutex_);
+            ++stats_.connection_count;
+        }
+        ResumeConnection(id, 0);
+    }
+}
+
+void RequestServer::DrainCompletions()
+{
+    std::vector<Completion> completions;
+    {
+        std::lock_guard guard(completion_mutex_);
+        completions.swap(completions_);
+    }
+
+    for (auto& completion : completions)
+    {
+        // Ответ на запрос закрытого соединения просто отбрасывается
+        const auto it = connections_.find(completion.connection_id);
+        if (it == connections_.end())
+        {
+            continue;
+        }
+        it->second.ready_responses.emplace(completion.request_index, std::move(completion.frame));
+        ResumeConnection(completion.connection_id, 0);
+    }
+}
+
+RequestServer::ConnectionTask RequestServer::ServeConnection(uint64_t connection_id, Connection& connection)
+{
+    auto& ready = connection.ready_responses;
+    while (true)
+    {
+        while (!ready.empty() && ready.begin()->first == connection.next_response)
+        {
+            connection.output += ready.begin()->second;
+            ready.erase(ready.begin());
+            ++connection.next_response;
+        }
+
+        if (!SendOutput(connection))
+        {
+            co_return;
+        }
+
+        try
+        {
+            DispatchRequests(connection_id, connection);
+        }
+        catch (const std::invalid_argument&)
+        {
+            // После испорченного кадра граница следующего неизвестна
+            co_return;
+        }
+
+        if (connection.is_input_closed && connection.next_request == connection.next_response
+            && connection.output.empty())
+        {
+            co_return;
+        }
+
+        const uint32_t events = co_await EventAwaiter{*this, connection_id, connection};
+        if ((events & (EPOLLERR | EPOLLHUP)) || ((events & EPOLLIN) && !ReadInput(connection)))
+        {
+            co_return;
+        }
+    }
+}
+
+void RequestServer::ResumeConnection(uint64_t connection_id, uint32_t events)
+{
+    const auto it = connections_.find(connection_id);
+    if (it == connections_.end())
+    {
+        return;
+    }
+    it->second.ready_events = events;
+    if (it->second.task.Resume())
+    {
+        CloseConnection(connection_id);
+    }
+}
+
+bool RequestServer::ReadInput(Connection& connection)
+{
+    // По одному чтению за событие: epoll сообщит об остатке снова, и соединения обслуживаются по очереди
+    char buffer[READ_BUFFER_SIZE];
+    while (true)
+    {
+        const ssize_t size = recv(connection.fd, buffer, sizeof(buffer), 0);
+        if (size > 0)
+        {
+            connection.input.append(buffer, size);
+            return true;
+        }
+        if (size == 0)
+        {
+            connection.is_input_closed = true;
+            return true;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+bool RequestServer::SendOutput(Connection& connection)
+{
+    while (connection.output_offset < connection.output.size())
+    {
+        const ssize_t size = send(connection.fd, connection.output.data() + connection.output_offset,
+                                  connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+        if (size < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+            return false;
+        }
+        connection.output_offset += size;
+    }
+
+    if (connection.output_offset == connection.output.size())
+    {
+        connection.output.clear();
+        connection.output_offset = 0;
+    }
+    else if (connection.output_offset > connection.output.size() / 2)
+    {
+        connection.output.erase(0, connection.output_offset);
+        connection.output_offset = 0;
+    }
+    return true;
+}
+
+void RequestServer::DispatchRequests(uint64_t connection_id, Connection& connection)
+{
+    size_t consumed = 0;
+    while (connection.next_request - connection.next_response < MAX_PIPELINED_REQUESTS
+           && connection.output.size() - connection.output_offset < MAX_PENDING_OUTPUT)
+    {
+        std::string_view payload;
+        const size_t frame_size = FindFrame(std::string_view(connection.input).substr(consumed), payload,
+                                            MAX_FRAME_SIZE);
+        if (frame_size == 0)
+        {
+            break;
+        }
+        consumed += frame_size;
+
+        {
+            std::lock_guard guard(completion_mutex_);
+            ++running_count_;
+            ++stats_.request_count;
+        }
+        scheduler_.Submit([this, connection_id, request_index = connection.next_request++,
+                           request = std::string(payload)] {
+            Complete(connection_id, request_index, MakeFrame(AnswerRequest(request_handler_, request)));
+        });
+    }
+    connection.input.erase(0, consumed);
+}
+
+void RequestServer::UpdateEvents(uint64_t connection_id, Connection& connection)
+{
+    uint32_t events = 0;
+    if (!connection.is_input_closed
+        && connection.next_request - connection.next_response < MAX_PIPELINED_REQUESTS
+        && connection.output.size() - connection.output_offset < MAX_PENDING_OUTPUT)
+    {
+        events |= EPOLLIN;
+    }
+    if (connection.output_offset < connection.output.size())
+    {
+        events |= EPOLLOUT;
+    }
+
+    if (events != connection.events)
+    {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = connection_id;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+}
+
+void RequestServer::CloseConnection(uint64_t connection_id)
+{
+    const auto it = connections_.find(connection_id);
+    if (it != connections_.end())
+    {
+        close(it->second.fd);
+        connections_.erase(it);
+    }
+}
+
+void RequestServer::Complete(uint64_t connection_id, uint64_t request_index, std::string frame)
+{
+    std::lock_guard guard(completion_mutex_);
+    completions_.push_back({connection_id, request_index, std::move(frame)});
+    const uint64_t value = 1;
+    [[maybe_unused]] const auto written = write(wake_fd_, &value, sizeof(value));
+    // Всё под блокировкой: как только счётчик обнулится, сервер может быть разрушен
+    if (--running_count_ == 0)
+    {
+        all_completed_.notify_all();
+    }
+}
@@ -0,0 +1,215 @@
+#pragma once
+#include "request_handler.h"
+#include "task_scheduler.h"
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace transport
+{
+    // Кадр протокола: длина содержимого десятичным числом, перевод строки и само содержимое.
+    // Запрос — JSON-документ со stat_requests, ответ — массив ответов, как в выводе JsonReader
+    std::string MakeFrame(std::string_view payload);
+
+    // Находит кадр в начале buffer и возвращает его полный размер или 0, если кадр пришёл не целиком.
+    // Бросает std::invalid_argument при неверном заголовке или содержимом длиннее max_size
+    size_t FindFrame(std::string_view buffer, std::string_view& payload, size_t max_size);
+
+    // Адрес вида unix:<путь> или tcp:<порт>; по TCP сервер слушает только 127.0.0.1.
+    // Возвращает подключённый блокирующий сокет
+    int ConnectSocket(std::string_view address);
+
+    struct RequestServerStats
+    {
+        size_t connection_count = 0;
+        size_t request_count = 0;
+    };
+
+    // Сервер stat_requests на epoll. Один поток принимает соединения, читает кадры и отправляет ответы,
+    // каждое соединение обслуживает сопрограмма, которая засыпает до готовности сокета или очередного
+    // ответа. Каждый запрос вычисляется отдельной задачей планировщика. Запросы одного соединения могут идти
+    // без ожидания ответов и вычисляться одновременно, ответы отправляются в порядке запросов.
+    // Обработчик только читается, поэтому его настройки нужно задать до запуска
+    class RequestServer
+    {
+    public:
+        RequestServer(const RequestHandler& request_handler, TaskScheduler& scheduler);
+
+        ~RequestServer();
+
+        RequestServer(const RequestServer&) = delete;
+        RequestServer& operator=(const RequestServer&) = delete;
+
+        void Listen(std::string_view address);
+
+        // Обслуживает соединения до вызова Stop или до SIGINT и SIGTERM, которые должны быть заблокированы
+        // во всех потоках до их создания. Перед возвратом дожидается уже вычисляемых запросов
+        void Run();
+
+        // Можно вызывать из любого потока
+        void Stop();
+
+        RequestServerStats GetStats() const;
+
+    private:
+        // Сопрограмма соединения. Запускается вызовом Resume, по завершении остаётся приостановленной,
+        // пока владелец не разрушит её
+        class ConnectionTask
+        {
+        public:
+            struct promise_type
+            {
+                ConnectionTask get_return_object()
+                {
+                    return ConnectionTask(std::coroutine_handle<promise_type>::from_promise(*this));
+                }
+                std::suspend_always initial_suspend() noexcept
+                {
+                    return {};
+                }
+                std::suspend_always final_suspend() noexcept
+                {
+                    return {};
+                }
+                void return_void() noexcept
+                {
+                }
+                // Исключение уходит к тому, кто возобновил сопрограмму, а она считается завершённой
+                void unhandled_exception()
+                {
+                    throw;
+                }
+            };
+
+            ConnectionTask() = default;
+
+            ConnectionTask(ConnectionTask&& other) noexcept
+                : handle_(std::exchange(other.handle_, nullptr))
+            {
+            }
+
+            ConnectionTask& operator=(ConnectionTask&& other) noexcept
+            {
+                std::swap(handle_, other.handle_);
+                return *this;
+            }
+
+            ~ConnectionTask()
+            {
+                if (handle_)
+                {
+                    handle_.destroy();
+                }
+            }
+
+            // true, если сопрограмма завершилась
+            bool Resume()
+            {
+                handle_.resume();
+                return handle_.done();
+            }
+
+        private:
+            explicit ConnectionTask(std::coroutine_handle<promise_type> handle)
+                : handle_(handle)
+            {
+            }
+
+            std::coroutine_handle<promise_type> handle_;
+        };
+
+        struct Connection
+        {
+            int fd = -1;
+            std::string input;
+            std::string output;
+            size_t output_offset = 0;
+            // Номер следующего запроса, отдаваемого на вычисление, и следующего ответа для отправки
+            uint64_t next_request = 0;
+            uint64_t next_response = 0;
+            // Вычисленные ответы, которые ждут предыдущих
+            std::map<uint64_t, std::string> ready_responses;
+            bool is_input_closed = false;
+            // События, на которые подписан сокет, и события, с которыми возобновлена сопрограмма;
+            // 0 — пришёл ответ из рабочего потока
+            uint32_t events = 0;
+            uint32_t ready_events = 0;
+            ConnectionTask task;
+        };
+
+        // Подписывает сокет на нужные соединению события и приостанавливает сопрограмму до их готовности
+        // или до очередного ответа. Возвращает готовые события
+        struct EventAwaiter
+        {
+            RequestServer& server;
+            uint64_t connection_id;
+            Connection& connection;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+            void await_suspend(std::coroutine_handle<>)
+            {
+                server.UpdateEvents(connection_id, connection);
+            }
+            uint32_t await_resume() const noexcept
+            {
+                return connection.ready_events;
+            }
+        };
+
+        struct Completion
+        {
+            uint64_t connection_id = 0;
+            uint64_t request_index = 0;
+            std::string frame;
+        };
+
+        void AcceptConnections();
+
+        void DrainCompletions();
+
+        // Цикл соединения: отправка готовых ответов, разбор кадров, ожидание сокета и чтение.
+        // Завершается, когда соединение нужно закрыть
+        ConnectionTask ServeConnection(uint64_t connection_id, Connection& connection);
+        void ResumeConnection(uint64_t connection_id, uint32_t events);
+
+        // false, если соединение нужно закрыть
+        bool ReadInput(Connection& connection);
+        bool SendOutput(Connection& connection);
+        void DispatchRequests(uint64_t connection_id, Connection& connection);
+        void UpdateEvents(uint64_t connection_id, Connection& connection);
+
+        void CloseConnection(uint64_t connection_id);
+
+        void Complete(uint64_t connection_id, uint64_t request_index, std::string frame);
+
+        const RequestHandler& request_handler_;
+        TaskScheduler& scheduler_;
+        int epoll_fd_ = -1;
+        int listen_fd_ = -1;
+        int wake_fd_ = -1;
+        int signal_fd_ = -1;
+        bool is_tcp_ = false;
+        std::string unix_path_;
+        std::unordered_map<uint64_t, Connection> connections_;
+        uint64_t next_connection_id_;
+        std::atomic<bool> is_stopping_{false};
+        RequestServerStats stats_;
+
+        // Ответы из рабочих потоков передаются потоку сервера через очередь и wake_fd_
+        mutable std::mutex completion_mutex_;
+        std::vector<Completion> completions_;
+        size_t running_count_ = 0;
+        std::condition_variable all_completed_;
+    };
+}
@@ -0,0 +1,89 @@
+#include "response_cache.h"
+
+using namespace transport;
+
+namespace
+{
+    // Примерные накладные расходы на элемент списка и хеш-таблицы
+    const size_t ENTRY_OVERHEAD = 96;
+}
+
+ResponseCache::ResponseCache(ResponseCacheSettings settings)
+    : settings_(settings)
+{}
+
+void ResponseCache::SetSettings(ResponseCacheSettings settings)
+{
+    std::lock_guard guard(mutex_);
+    settings_ = settings;
+    EvictUntil(settings_.max_bytes);
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::Find(std::string_view key)
+{
+    std::lock_guard guard(mutex_);
+
+    const auto it = index_.find(key);
+    if (it == index_.end())
+    {
+        ++stats_.misses;
+        return nullptr;
+    }
+
+    ++stats_.hits;
+    if (settings_.eviction_policy == EvictionPolicy::LRU)
+    {
+        entries_.splice(entries_.begin(), entries_, it->second);
+    }
+    return it->second->response;
+}
+
+void ResponseCache::Insert(std::string key, CachedResponse response)
+{
+    const size_t size = GetEntrySize(key, response);
+    std::lock_guard guard(mutex_);
+
+    if (size > settings_.max_bytes || index_.count(key) > 0)
+    {
+        return;
+    }
+
+    EvictUntil(settings_.max_bytes - size);
+    entries_.push_front({std::move(key), std::make_shared<const CachedResponse>(std::move(response))});
+    index_.emplace(entries_.front().key, entries_.begin());
+    ++stats_.entry_count;
+    stats_.byte_count += size;
+}
+
+void ResponseCache::Clear()
+{
+    std::lock_guard guard(mutex_);
+    index_.clear();
+    entries_.clear();
+    stats_.entry_count = 0;
+    stats_.byte_count = 0;
+}
+
+ResponseCacheStats ResponseCache::GetStats() const
+{
+    std::lock_guard guard(mutex_);
+    return stats_;
+}
+
+size_t ResponseCache::GetEntrySize(const std::string& key, const CachedResponse& response)
+{
+    return key.size() + response.text.size() + ENTRY_OVERHEAD;
+}
+
+void ResponseCache::EvictUntil(size_t max_bytes)
+{
+    while (stats_.byte_count > max_bytes)
+    {
+        const auto& entry = entries_.back();
+        stats_.byte_count -= GetEntrySize(entry.key, *entry.response);
+        index_.erase(entry.key);
+        entries_.pop_back();
+        --stats_.entry_count;
+        ++stats_.evictions;
+    }
+}
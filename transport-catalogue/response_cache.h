@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace transport
+{
+    enum class EvictionPolicy
+    {
+        // Вытесняется ответ, к которому дольше всех не обращались
+        LRU,
+        // Вытесняется ответ, сохранённый раньше всех; попадания порядок не меняют
+        FIFO
+    };
+
+    struct ResponseCacheSettings
+    {
+        // Ограничение на суммарный размер ключей и ответов; 0 отключает кэш
+        size_t max_bytes = size_t(64) << 20;
+        EvictionPolicy eviction_policy = EvictionPolicy::LRU;
+    };
+
+    // Ответ, выведенный как элемент массива ответов. Ответы на одинаковые запросы различаются только
+    // request_id, поэтому его значение вырезано из text и при выводе вставляется в позицию request_id_offset
+    struct CachedResponse
+    {
+        std::string text;
+        size_t request_id_offset = 0;
+    };
+
+    struct ResponseCacheStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t entry_count = 0;
+        size_t byte_count = 0;
+    };
+
+    // Потокобезопасный кэш готовых ответов с ограничением по памяти. Ответ хранится текстом и отдаётся
+    // через shared_ptr, поэтому вытеснение не мешает тем, кто его ещё читает
+    class ResponseCache
+    {
+    public:
+        explicit ResponseCache(ResponseCacheSettings settings = {});
+
+        // Меняет настройки; при уменьшении лимита лишние ответы сразу вытесняются
+        void SetSettings(ResponseCacheSettings settings);
+
+        // Ответ по ключу или nullptr; учитывается как попадание или промах
+        std::shared_ptr<const CachedResponse> Find(std::string_view key);
+
+        // Сохраняет ответ, вытесняя старые до укладывания в лимит. Ответ больше лимита не сохраняется
+        void Insert(std::string key, CachedResponse response);
+
+        void Clear();
+
+        ResponseCacheStats GetStats() const;
+
+    private:
+        struct Entry
+        {
+            std::string key;
+            std::shared_ptr<const CachedResponse> response;
+        };
+
+        static size_t GetEntrySize(const std::string& key, const CachedResponse& response);
+
+        void EvictUntil(size_t max_bytes);
+
+        mutable std::mutex mutex_;
+        ResponseCacheSettings settings_;
+        // Начало списка вытесняется последним
+        std::list<Entry> entries_;
+        // Ключи ссылаются на строки в entries_
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+        ResponseCacheStats stats_;
+    };
+}
@@ -0,0 +1,453 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <tuple>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace transport;
+
+namespace
+{
+    using namespace std::literals;
+
+    inline constexpr size_t SECTION_ALIGNMENT = 8;
+    inline constexpr uint32_t SNAPSHOT_NO_STOP = UINT32_MAX;
+
+    class SnapshotWriter
+    {
+    public:
+        explicit SnapshotWriter(const std::string& path)
+            : out_(path, std::ios::binary)
+        {
+            if (!out_)
+            {
+                throw SnapshotError("Can't open snapshot file for writing: "s + path);
+            }
+
+            // Место под заголовок, он дописывается в конце, когда известны все секции
+            Pad(sizeof(SnapshotHeader));
+        }
+
+        template <typename T>
+        SnapshotSection WriteSection(const std::vector<T>& items)
+        {
+            Pad((SECTION_ALIGNMENT - position_ % SECTION_ALIGNMENT) % SECTION_ALIGNMENT);
+            SnapshotSection section{position_, items.size()};
+            Write(items.data(), items.size() * sizeof(T));
+            return section;
+        }
+
+        void Finish(const SnapshotHeader& header)
+        {
+            out_.seekp(0);
+            out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+            if (!out_)
+            {
+                throw SnapshotError("Snapshot writing error"s);
+            }
+        }
+
+    private:
+        void Write(const void* data, size_t size)
+        {
+            out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            position_ += size;
+        }
+
+        void Pad(size_t size)
+        {
+            static const char zeros[sizeof(SnapshotHeader)] = {};
+            Write(zeros, size);
+        }
+
+        std::ofstream out_;
+        uint64_t position_ = 0;
+    };
+
+    template <typename T>
+    const T* GetSection(const MappedFile& file, const SnapshotSection& section)
+    {
+        if (section.offset % alignof(T) != 0
+            || section.offset > file.GetSize()
+            || section.count > (file.GetSize() - section.offset) / sizeof(T))
+        {
+            throw SnapshotError("Snapshot section is out of file bounds"s);
+        }
+
+        return reinterpret_cast<const T*>(file.GetData() + section.offset);
+    }
+
+    NameIndexView GetNameIndex(const MappedFile& file, uint64_t hash_seed, const SnapshotSection& buckets,
+                               const SnapshotSection& slots)
+    {
+        return {hash_seed, GetSection<uint32_t>(file, buckets), buckets.count, GetSection<NameIndexSlot>(file, slots),
+                slots.count};
+    }
+
+    const SnapshotHeader& ReadHeader(const MappedFile& file)
+    {
+        if (file.GetSize() < sizeof(SnapshotHeader))
+        {
+            throw SnapshotError("Snapshot file is too small"s);
+        }
+
+        const auto& header = *reinterpret_cast<const SnapshotHeader*>(file.GetData());
+
+        if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+        {
+            throw SnapshotError("Not a transport catalogue snapshot"s);
+        }
+
+        if (header.version != SNAPSHOT_VERSION || header.header_size != sizeof(SnapshotHeader))
+        {
+            throw SnapshotError("Unsupported snapshot version"s);
+        }
+
+        return header;
+    }
+}
+
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw SnapshotError("Can't open snapshot file: "s + path);
+    }
+
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close(fd);
+        throw SnapshotError("Can't read snapshot file: "s + path);
+    }
+
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        throw SnapshotError("Can't map snapshot file: "s + path);
+    }
+
+    data_ = static_cast<const char*>(data);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<char*>(data_), size_);
+}
+
+const char* MappedFile::GetData() const
+{
+    return data_;
+}
+
+size_t MappedFile::GetSize() const
+{
+    return size_;
+}
+
+void transport::SaveSnapshot(const Catalogue& catalogue, const std::string& path)
+{
+    const auto& stops = catalogue.GetStops();
+    const auto& buses = catalogue.GetBuses();
+
+    std::vector<char> names;
+    auto add_name = [&names](std::string_view name) {
+        const uint64_t offset = names.size();
+        names.insert(names.end(), name.begin(), name.end());
+        return offset;
+    };
+
+    // Удалённые остановки в снимок не попадают, поэтому номера остальных сжимаются
+    std::vector<uint32_t> snapshot_ids(stops.size(), SNAPSHOT_NO_STOP);
+    std::vector<SnapshotStop> stop_records;
+    std::vector<std::optional<std::string_view>> stop_names;
+    stop_records.reserve(stops.size());
+    stop_names.reserve(stops.size());
+
+    for (const auto& stop : stops)
+    {
+        if (!stop)
+        {
+            continue;
+        }
+
+        snapshot_ids[stop->id] = uint32_t(stop_records.size());
+        stop_names.push_back(stop->name);
+        stop_records.push_back({add_name(stop->name), uint32_t(stop->name.size()), 0, stop->coordinates.lat, stop->coordinates.lng});
+    }
+
+    std::vector<SnapshotBus> bus_records;
+    std::vector<SnapshotBusStats> bus_stats;
+    std::vector<uint32_t> route_stops;
+    std::vector<uint64_t> departures_offsets;
+    std::vector<double> departures;
+    std::vector<std::vector<uint32_t>> stop_to_buses(stop_records.size());
+    std::vector<std::optional<std::string_view>> bus_names;
+    bus_records.reserve(buses.size());
+    bus_stats.reserve(buses.size());
+    bus_names.reserve(buses.size());
+
+    for (const auto& [bus_name, bus_ptr] : buses)
+    {
+        const auto bus_id = uint32_t(bus_records.size());
+        bus_names.push_back(bus_name);
+        bus_records.push_back({add_name(bus_name), uint32_t(bus_name.size()), bus_ptr->is_roundtrip,
+                               route_stops.size(), bus_ptr->stop_ids.size()});
+        departures_offsets.push_back(departures.size());
+        departures.insert(departures.end(), bus_ptr->departures.begin(), bus_ptr->departures.end());
+
+        for (const size_t stop_id : bus_ptr->stop_ids)
+        {
+            const uint32_t snapshot_id = snapshot_ids[stop_id];
+            route_stops.push_back(snapshot_id);
+
+            auto& stop_buses = stop_to_buses[snapshot_id];
+            if (stop_buses.empty() || stop_buses.back() != bus_id)
+            {
+                stop_buses.push_back(bus_id);
+            }
+        }
+
+        // Маршрут без заданных расстояний сохраняется, но без статистики, как и в справочнике
+        SnapshotBusStats stats{0, 0, 0, 1, 0.0};
+        if (!bus_ptr->stop_ids.empty())
+        {
+            try
+            {
+                const auto info = catalogue.FindBus(bus_name);
+                stats = {info->stops_on_route, info->unique_stops, info->route_length, 1, info->curvature};
+            }
+            catch (const std::out_of_range&)
+            {
+                stats.is_measured = 0;
+            }
+        }
+        bus_stats.push_back(stats);
+    }
+
+    departures_offsets.push_back(departures.size());
+
+    std::vector<uint32_t> stop_buses_offsets;
+    std::vector<uint32_t> stop_buses;
+    stop_buses_offsets.reserve(stop_records.size() + 1);
+
+    // Автобусы перебирались в порядке id, поэтому списки уже отсортированы и без повторов
+    for (const auto& ids : stop_to_buses)
+    {
+        stop_buses_offsets.push_back(uint32_t(stop_buses.size()));
+        stop_buses.insert(stop_buses.end(), ids.begin(), ids.end());
+    }
+    stop_buses_offsets.push_back(uint32_t(stop_buses.size()));
+
+    std::vector<SnapshotDistance> distances;
+    distances.reserve(catalogue.GetDistances().size());
+
+    for (const auto& [stop_pair, distance] : catalogue.GetDistances())
+    {
+        const uint32_t from = snapshot_ids[stop_pair.first];
+        const uint32_t to = snapshot_ids[stop_pair.second];
+        if (from != SNAPSHOT_NO_STOP && to != SNAPSHOT_NO_STOP)
+        {
+            distances.push_back({from, to, distance, 0});
+        }
+    }
+
+    std::sort(distances.begin(), distances.end(), [](const SnapshotDistance& lhs, const SnapshotDistance& rhs) {
+        return std::tie(lhs.from, lhs.to) < std::tie(rhs.from, rhs.to);
+    });
+
+    const PerfectNameIndex stop_index(stop_names);
+    const PerfectNameIndex bus_index(bus_names);
+
+    SnapshotWriter writer(path);
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.catalogue_version = catalogue.GetVersion();
+    header.stop_index_seed = stop_index.GetHashSeed();
+    header.bus_index_seed = bus_index.GetHashSeed();
+    header.names = writer.WriteSection(names);
+    header.stops = writer.WriteSection(stop_records);
+    header.stop_index_buckets = writer.WriteSection(stop_index.GetBucketSeeds());
+    header.stop_index_slots = writer.WriteSection(stop_index.GetSlots());
+    header.buses = writer.WriteSection(bus_records);
+    header.bus_index_buckets = writer.WriteSection(bus_index.GetBucketSeeds());
+    header.bus_index_slots = writer.WriteSection(bus_index.GetSlots());
+    header.route_stops = writer.WriteSection(route_stops);
+    header.bus_stats = writer.WriteSection(bus_stats);
+    header.distances = writer.WriteSection(distances);
+    header.stop_buses_offsets = writer.WriteSection(stop_buses_offsets);
+    header.stop_buses = writer.WriteSection(stop_buses);
+    header.departures_offsets = writer.WriteSection(departures_offsets);
+    header.departures = writer.WriteSection(departures);
+    writer.Finish(header);
+}
+
+MappedCatalogue::MappedCatalogue(const std::string& path)
+    : file_(path)
+    , header_(&ReadHeader(file_))
+{
+    if (header_->bus_stats.count != header_->buses.count
+        || header_->stop_buses_offsets.count != header_->stops.count + 1
+        || header_->departures_offsets.count != header_->buses.count + 1)
+    {
+        throw SnapshotError("Snapshot sections are inconsistent"s);
+    }
+
+    names_ = GetSection<char>(file_, header_->names);
+    stops_ = GetSection<SnapshotStop>(file_, header_->stops);
+    buses_ = GetSection<SnapshotBus>(file_, header_->buses);
+    route_stops_ = GetSection<uint32_t>(file_, header_->route_stops);
+    bus_stats_ = GetSection<SnapshotBusStats>(file_, header_->bus_stats);
+    distances_ = GetSection<SnapshotDistance>(file_, header_->distances);
+    stop_buses_offsets_ = GetSection<uint32_t>(file_, header_->stop_buses_offsets);
+    stop_buses_ = GetSection<uint32_t>(file_, header_->stop_buses);
+    departures_offsets_ = GetSection<uint64_t>(file_, header_->departures_offsets);
+    departures_ = GetSection<double>(file_, header_->departures);
+
+    stop_index_ = GetNameIndex(file_, header_->stop_index_seed, header_->stop_index_buckets, header_->stop_index_slots);
+    bus_index_ = GetNameIndex(file_, header_->bus_index_seed, header_->bus_index_buckets, header_->bus_index_slots);
+
+    bus_names_.reserve(header_->buses.count);
+    for (size_t bus_id = 0; bus_id < header_->buses.count; ++bus_id)
+    {
+        bus_names_.push_back(GetBusName(bus_id));
+    }
+}
+
+std::optional<BusInfo> MappedCatalogue::FindBus(std::string_view name_view) const
+{
+    const auto bus_id = bus_index_.FindCandidate(name_view);
+    if (!bus_id || *bus_id >= header_->buses.count || GetBusName(*bus_id) != name_view)
+    {
+        return {};
+    }
+
+    const SnapshotBusStats& stats = bus_stats_[*bus_id];
+    if (!stats.is_measured)
+    {
+        throw std::out_of_range("Bus "s + std::string{name_view} + " has no road distance between some stops"s);
+    }
+    return BusInfo{GetBusName(*bus_id), stats.stops_on_route, stats.unique_stops, stats.route_length, stats.curvature};
+}
+
+std::optional<StopInfo> MappedCatalogue::FindStop(std::string_view name_view) const
+{
+    const auto candidate = stop_index_.FindCandidate(name_view);
+    if (!candidate || *candidate >= header_->stops.count || GetStopName(*candidate) != name_view)
+    {
+        return {};
+    }
+
+    const size_t stop_id = *candidate;
+    return StopInfo{GetStopName(stop_id), {stop_buses_ + stop_buses_offsets_[stop_id],
+                                           stop_buses_ + stop_buses_offsets_[stop_id + 1], bus_names_.data()}, stop_id};
+}
+
+uint64_t MappedCatalogue::GetVersion() const
+{
+    return header_->catalogue_version;
+}
+
+size_t MappedCatalogue::GetStopCount() const
+{
+    return header_->stops.count;
+}
+
+std::string_view MappedCatalogue::GetStopName(size_t stop_id) const
+{
+    return {names_ + stops_[stop_id].name_offset, stops_[stop_id].name_size};
+}
+
+Coordinates MappedCatalogue::GetStopCoordinates(size_t stop_id) const
+{
+    return {stops_[stop_id].lat, stops_[stop_id].lng};
+}
+
+std::optional<int> MappedCatalogue::GetDistance(size_t stop_id_from, size_t stop_id_to) const
+{
+    // Расстояния в снимке упорядочены по парам (from, to)
+    auto find = [this](size_t from, size_t to) -> std::optional<int> {
+        const SnapshotDistance* last = distances_ + header_->distances.count;
+        const auto it = std::lower_bound(distances_, last, std::pair{from, to}, [](const SnapshotDistance& distance, const auto& key) {
+            return std::pair<size_t, size_t>{distance.from, distance.to} < key;
+        });
+        if (it == last || it->from != from || it->to != to)
+        {
+            return std::nullopt;
+        }
+        return it->distance;
+    };
+
+    if (const auto distance = find(stop_id_from, stop_id_to))
+    {
+        return distance;
+    }
+    return find(stop_id_to, stop_id_from);
+}
+
+void MappedCatalogue::ForEachRoute(const std::function<void(Route)>& callback) const
+{
+    for (size_t bus_id = 0; bus_id < header_->buses.count; ++bus_id)
+    {
+        const SnapshotBus& bus = buses_[bus_id];
+        const uint32_t* first = route_stops_ + bus.stops_offset;
+        callback(Route{GetBusName(bus_id), bus.is_roundtrip != 0, {first, first + bus.stops_count},
+                       {departures_ + departures_offsets_[bus_id], departures_ + departures_offsets_[bus_id + 1]}});
+    }
+}
+
+const NetworkStats& MappedCatalogue::GetNetworkStats() const
+{
+    return network_stats_.Get([this] {
+        return BuildNetworkStats();
+    });
+}
+
+const StopBusIncidence& MappedCatalogue::GetIncidence() const
+{
+    return incidence_.Get([this] {
+        return StopBusIncidence(*this);
+    });
+}
+
+NetworkStats MappedCatalogue::BuildNetworkStats() const
+{
+    const size_t bus_count = header_->buses.count;
+    std::vector<BusInfo> buses;
+    buses.reserve(bus_count);
+    for (size_t bus_id = 0; bus_id < bus_count; ++bus_id)
+    {
+        const SnapshotBusStats& stats = bus_stats_[bus_id];
+        if (stats.is_measured)
+        {
+            buses.push_back({GetBusName(bus_id), stats.stops_on_route, stats.unique_stops, stats.route_length, stats.curvature});
+        }
+    }
+
+    std::vector<NetworkStats::StopRank> served_stops;
+    for (size_t stop_id = 0; stop_id < header_->stops.count; ++stop_id)
+    {
+        const size_t stop_bus_count = stop_buses_offsets_[stop_id + 1] - stop_buses_offsets_[stop_id];
+        if (stop_bus_count > 0)
+        {
+            served_stops.push_back({GetStopName(stop_id), stop_bus_count});
+        }
+    }
+
+    return MakeNetworkStats(std::move(buses), std::move(served_stops), bus_count, header_->stops.count);
+}
+
+std::string_view MappedCatalogue::GetBusName(size_t bus_id) const
+{
+    return {names_ + buses_[bus_id].name_offset, buses_[bus_id].name_size};
+}
\ No newline at end of file
@@ -0,0 +1,180 @@
+#pragma once
+#include "transport_catalogue.h"
+#include "name_index.h"
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace transport
+{
+    class SnapshotError : public std::runtime_error
+    {
+    public:
+        using runtime_error::runtime_error;
+    };
+
+    // Бинарный снимок справочника. Файл состоит из заголовка и секций-массивов записей фиксированного размера,
+    // выровненных на 8 байт, поэтому после отображения в память записи читаются на месте без разбора.
+    // Порядок байт — родной для машины, на которой снимок собран.
+    inline constexpr char SNAPSHOT_MAGIC[8] = {'T', 'C', 'S', 'N', 'A', 'P', '\0', '\0'};
+    inline constexpr uint32_t SNAPSHOT_VERSION = 3;
+
+    struct SnapshotSection
+    {
+        uint64_t offset = 0;
+        uint64_t count = 0;
+    };
+
+    struct SnapshotHeader
+    {
+        char magic[8];
+        uint32_t version = SNAPSHOT_VERSION;
+        uint32_t header_size = sizeof(SnapshotHeader);
+        uint64_t catalogue_version = 0;
+        // Зёрна совершенных хеш-функций названий остановок и автобусов (см. PerfectNameIndex)
+        uint64_t stop_index_seed = 0;
+        uint64_t bus_index_seed = 0;
+        // char: названия остановок и автобусов подряд, без разделителей
+        SnapshotSection names;
+        // SnapshotStop, индекс — Stop::id
+        SnapshotSection stops;
+        // uint32_t и NameIndexSlot: таблицы PerfectNameIndex названий остановок, ячейки хранят id остановок
+        SnapshotSection stop_index_buckets;
+        SnapshotSection stop_index_slots;
+        // SnapshotBus в порядке возрастания названий; индекс — id автобуса в снимке
+        SnapshotSection buses;
+        // Таблицы PerfectNameIndex названий автобусов, ячейки хранят id автобусов в снимке
+        SnapshotSection bus_index_buckets;
+        SnapshotSection bus_index_slots;
+        // uint32_t: id остановок всех маршрутов подряд
+        SnapshotSection route_stops;
+        // SnapshotBusStats, индекс — id автобуса
+        SnapshotSection bus_stats;
+        // SnapshotDistance в порядке возрастания пар (from, to)
+        SnapshotSection distances;
+        // uint32_t: stops.count + 1 границ списков автобусов остановок в stop_buses
+        SnapshotSection stop_buses_offsets;
+        // uint32_t: id автобусов каждой остановки по возрастанию, остановки подряд
+        SnapshotSection stop_buses;
+        // uint64_t: buses.count + 1 границ расписаний автобусов в departures
+        SnapshotSection departures_offsets;
+        // double: отправления рейсов каждого автобуса по возрастанию, автобусы подряд
+        SnapshotSection departures;
+    };
+
+    struct SnapshotStop
+    {
+        uint64_t name_offset;
+        uint32_t name_size;
+        uint32_t reserved;
+        double lat;
+        double lng;
+    };
+
+    struct SnapshotBus
+    {
+        uint64_t name_offset;
+        uint32_t name_size;
+        uint32_t is_roundtrip;
+        uint64_t stops_offset;
+        uint64_t stops_count;
+    };
+
+    struct SnapshotBusStats
+    {
+        int32_t stops_on_route;
+        int32_t unique_stops;
+        int32_t route_length;
+        // 0, если между какими-то остановками маршрута не задано расстояние; тогда остальные поля не заполнены
+        uint32_t is_measured;
+        double curvature;
+    };
+
+    struct SnapshotDistance
+    {
+        uint32_t from;
+        uint32_t to;
+        int32_t distance;
+        uint32_t reserved;
+    };
+
+    // Файл, отображённый в память только для чтения
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& path);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile();
+
+        const char* GetData() const;
+
+        size_t GetSize() const;
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // Справочник только для чтения, который отвечает на запросы прямо по отображённому в память снимку:
+    // вместо указателей — смещения и id, названия — string_view в отображение. Несколько процессов,
+    // открывших один снимок, разделяют одну физическую копию данных через page cache.
+    // Снимок считается доверенным: при открытии проверяются заголовок и границы секций, но не отдельные записи.
+    class MappedCatalogue : public CatalogueReader
+    {
+    public:
+        explicit MappedCatalogue(const std::string& path);
+
+        std::optional<BusInfo> FindBus(std::string_view name_view) const override;
+
+        std::optional<StopInfo> FindStop(std::string_view name_view) const override;
+
+        uint64_t GetVersion() const override;
+
+        size_t GetStopCount() const override;
+
+        std::string_view GetStopName(size_t stop_id) const override;
+
+        Coordinates GetStopCoordinates(size_t stop_id) const override;
+
+        std::optional<int> GetDistance(size_t stop_id_from, size_t stop_id_to) const override;
+
+        void ForEachRoute(const std::function<void(Route)>& callback) const override;
+
+        const NetworkStats& GetNetworkStats() const override;
+
+        const StopBusIncidence& GetIncidence() const override;
+
+    private:
+        std::string_view GetBusName(size_t bus_id) const;
+
+        NetworkStats BuildNetworkStats() const;
+
+        MappedFile file_;
+        const SnapshotHeader* header_ = nullptr;
+        const char* names_ = nullptr;
+        const SnapshotStop* stops_ = nullptr;
+        const SnapshotBus* buses_ = nullptr;
+        const uint32_t* route_stops_ = nullptr;
+        const SnapshotBusStats* bus_stats_ = nullptr;
+        const SnapshotDistance* distances_ = nullptr;
+        const uint32_t* stop_buses_offsets_ = nullptr;
+        const uint32_t* stop_buses_ = nullptr;
+        const uint64_t* departures_offsets_ = nullptr;
+        const double* departures_ = nullptr;
+        // Названия автобусов по id снимка, чтобы отдавать списки автобусов остановок прямо из stop_buses
+        std::vector<std::string_view> bus_names_;
+        // Совершенные хеш-функции названий строятся при сохранении снимка и читаются прямо из отображения
+        NameIndexView stop_index_;
+        NameIndexView bus_index_;
+        LazyIndex<NetworkStats> network_stats_{"network_stats"};
+        LazyIndex<StopBusIncidence> incidence_{"incidence"};
+    };
+
+    void SaveSnapshot(const Catalogue& catalogue, const std::string& path);
+}
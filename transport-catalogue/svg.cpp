@@ -1,4 +1,5 @@
 #include "svg.h"
+#include <iomanip>
 
 using namespace std::literals;
 
@@ -175,13 +176,29 @@ namespace svg {
         return *this;
     }
 
+    Text& Text::ResetOffset() {
+        offset_.reset();
+        return *this;
+    }
+
+    Text& Text::ResetFontSize() {
+        size_.reset();
+        return *this;
+    }
+
     void Text::RenderObject(const RenderContext& context) const {
         auto& out = context.out;
         out << "<text "sv;
         RenderAttrs(context.out);
         out << " x=\""sv << pos_.x << "\" y=\""sv << pos_.y << "\" "sv;
-        out << "dx=\""sv << offset_.x << "\" dy=\""sv << offset_.y << "\" "sv;
-        out << "font-size=\""sv << size_ << "\" "sv;
+
+        if (offset_) {
+            out << "dx=\""sv << offset_->x << "\" dy=\""sv << offset_->y << "\" "sv;
+        }
+
+        if (size_) {
+            out << "font-size=\""sv << *size_ << "\" "sv;
+        }
 
         if (!font_family_.empty()) {
             out << "font-family=\""sv << font_family_ << "\" "sv;
@@ -220,6 +237,22 @@ namespace svg {
         out << "</text>";
     }
 
+// ---------- Style ------------------
+
+    Style& Style::AddRule(std::string selector, std::string declarations) {
+        rules_.emplace_back(std::move(selector), std::move(declarations));
+        return *this;
+    }
+
+    void Style::RenderObject(const RenderContext& context) const {
+        auto& out = context.out;
+        out << "<style>"sv;
+        for (const auto& [selector, declarations] : rules_) {
+            out << selector << '{' << declarations << '}';
+        }
+        out << "</style>"sv;
+    }
+
 // ---------- Document ------------------
 
     void Document::AddPtr(std::unique_ptr<Object>&& obj) {
@@ -227,15 +260,38 @@ namespace svg {
     }
 
     void Document::Render(std::ostream& out) const {
-        RenderContext context(out);
+        RenderBegin(out);
+        RenderObjects(out);
+        RenderEnd(out);
+    }
 
-        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
+    void Document::RenderObjects(std::ostream& out) const {
+        const auto flags = out.flags();
+        const auto precision = out.precision();
+        if (precision_) {
+            out << std::fixed << std::setprecision(*precision_);
+        }
+
+        RenderContext context(out);
 
         for (const auto& object : objects_) {
             object->Render(context);
         }
 
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    void Document::SetPrecision(int precision) {
+        precision_ = precision;
+    }
+
+    void Document::RenderBegin(std::ostream& out) {
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
+        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
+    }
+
+    void Document::RenderEnd(std::ostream& out) {
         out << "</svg>"sv;
     }
 }  // namespace svg
\ No newline at end of file
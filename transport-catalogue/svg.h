@@ -6,7 +6,7 @@
 #include <vector>
 #include <optional>
 #include <variant>
-#include <cstdint>
+#include <utility>
 
 namespace svg {
 
@@ -105,6 +105,9 @@ namespace svg {
         Owner& SetStrokeLineCap(StrokeLineCap line_cap);
         Owner& SetStrokeLineJoin(StrokeLineJoin line_join);
 
+        // Задаёт CSS-класс объекта (атрибут class), чтобы общие свойства описывались один раз в <style>
+        Owner& SetClassName(std::string class_name);
+
     protected:
         ~PathProps() = default;
 
@@ -118,6 +121,7 @@ namespace svg {
         std::optional<double> stroke_width_;
         std::optional<StrokeLineCap> stroke_linecap_;
         std::optional<StrokeLineJoin> stroke_linejoin_;
+        std::string class_name_;
     };
 
     class Circle final : public Object, public PathProps<Circle> {
@@ -162,17 +166,32 @@ namespace svg {
         // Задаёт текстовое содержимое объекта (отображается внутри тега text)
         Text& SetData(std::string data);
 
+        // Убирают атрибуты dx, dy и font-size, например когда смещение учтено в позиции, а размер задан через CSS
+        Text& ResetOffset();
+        Text& ResetFontSize();
+
     private:
         void RenderObject(const RenderContext& context) const override;
 
         Point pos_;
-        Point offset_;
-        uint32_t size_ = 1;
+        std::optional<Point> offset_ = Point{};
+        std::optional<uint32_t> size_ = 1;
         std::string font_family_;
         std::string font_weight_;
         std::string data_;
     };
 
+    // Блок <style> с CSS-правилами, на которые ссылаются объекты через SetClassName
+    class Style final : public Object {
+    public:
+        Style& AddRule(std::string selector, std::string declarations);
+
+    private:
+        void RenderObject(const RenderContext& context) const override;
+
+        std::vector<std::pair<std::string, std::string>> rules_;
+    };
+
     class ObjectContainer {
     public:
         virtual ~ObjectContainer() = default;
@@ -198,8 +217,19 @@ namespace svg {
         // Выводит в ostream svg-представление документа
         void Render(std::ostream& out) const;
 
+        // Выводит в ostream только объекты документа, без пролога и тега <svg>
+        void RenderObjects(std::ostream& out) const;
+
+        // Числа выводятся с фиксированным количеством знаков после запятой; формат потока восстанавливается
+        void SetPrecision(int precision);
+
+        // Выводят пролог с открывающим тегом <svg> и закрывающий тег документа
+        static void RenderBegin(std::ostream& out);
+        static void RenderEnd(std::ostream& out);
+
     private:
         std::vector<std::unique_ptr<Object>> objects_;
+        std::optional<int> precision_;
     };
 
     template <typename Owner>
@@ -232,10 +262,19 @@ namespace svg {
         return AsOwner();
     }
 
+    template <typename Owner>
+    Owner& PathProps<Owner>::SetClassName(std::string class_name) {
+        class_name_ = std::move(class_name);
+        return AsOwner();
+    }
+
     template <typename Owner>
     void PathProps<Owner>::RenderAttrs(std::ostream& out) const {
         using namespace std::literals;
 
+        if (!class_name_.empty()) {
+            out << " class=\""sv << class_name_ << "\""sv;
+        }
         if (fill_color_) {
             out << " fill=\""sv << *fill_color_ << "\""sv;
         }
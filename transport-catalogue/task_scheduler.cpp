@@ -0,0 +1,229 @@
+#include "task_scheduler.h"
+#include <algorithm>
+#include <exception>
+
+using namespace transport;
+
+namespace
+{
+    thread_local TaskScheduler* current_scheduler = nullptr;
+    thread_local size_t current_worker_index = 0;
+}
+
+TaskScheduler::TaskScheduler(size_t worker_count)
+{
+    if (worker_count == 0)
+    {
+        worker_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        threads_.emplace_back([this, i] {
+            Run(i);
+        });
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard guard(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto& thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void TaskScheduler::Submit(Task task)
+{
+    // Счётчик растёт раньше, чем задача становится видна, чтобы взявший её поток не увёл его ниже нуля
+    {
+        std::lock_guard guard(sleep_mutex_);
+        ++pending_count_;
+    }
+
+    if (current_scheduler == this)
+    {
+        auto& worker = *workers_[current_worker_index];
+        std::lock_guard guard(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    else
+    {
+        std::lock_guard guard(shared_mutex_);
+        shared_tasks_.push_back(std::move(task));
+    }
+
+    wake_.notify_one();
+}
+
+size_t TaskScheduler::GetWorkerCount() const
+{
+    return workers_.size();
+}
+
+void TaskScheduler::ForEachChunk(size_t count, size_t chunk_count,
+                                 const std::function<void(size_t, size_t)>& func)
+{
+    chunk_count = std::min(chunk_count, count);
+    if (chunk_count == 0)
+    {
+        return;
+    }
+
+    struct ChunkLoop
+    {
+        size_t count = 0;
+        size_t chunk_count = 0;
+        const std::function<void(size_t, size_t)>* func = nullptr;
+        std::atomic<size_t> next_chunk{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t finished_count = 0;
+        std::exception_ptr error;
+    };
+
+    // Помощники могут запуститься уже после возврата, поэтому состояние живёт, пока на него ссылаются;
+    // func они вызывают, только если успели взять кусок
+    auto loop = std::make_shared<ChunkLoop>();
+    loop->count = count;
+    loop->chunk_count = chunk_count;
+    loop->func = &func;
+
+    auto run_chunks = [](ChunkLoop& loop) {
+        for (size_t chunk = loop.next_chunk++; chunk < loop.chunk_count; chunk = loop.next_chunk++)
+        {
+            std::exception_ptr error;
+            try
+            {
+                (*loop.func)(loop.count * chunk / loop.chunk_count, loop.count * (chunk + 1) / loop.chunk_count);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            std::lock_guard guard(loop.mutex);
+            if (error && !loop.error)
+            {
+                loop.error = error;
+            }
+            if (++loop.finished_count == loop.chunk_count)
+            {
+                loop.finished.notify_all();
+            }
+        }
+    };
+
+    const size_t helper_count = std::min(chunk_count, workers_.size()) - 1;
+    for (size_t i = 0; i < helper_count; ++i)
+    {
+        Submit([loop, run_chunks] {
+            run_chunks(*loop);
+        });
+    }
+
+    run_chunks(*loop);
+
+    std::unique_lock lock(loop->mutex);
+    loop->finished.wait(lock, [&loop] {
+        return loop->finished_count == loop->chunk_count;
+    });
+    if (loop->error)
+    {
+        std::rethrow_exception(loop->error);
+    }
+}
+
+TaskScheduler* TaskScheduler::GetCurrent()
+{
+    return current_scheduler;
+}
+
+void TaskScheduler::Run(size_t worker_index)
+{
+    current_scheduler = this;
+    current_worker_index = worker_index;
+    Task task;
+
+    while (true)
+    {
+        if (TryPop(worker_index, task))
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        // Задача могла быть поставлена после неудачного поиска, поэтому засыпать можно, только пока
+        // счётчик под блокировкой равен нулю. Остановка — когда задач не осталось
+        std::unique_lock lock(sleep_mutex_);
+        wake_.wait(lock, [this] {
+            return pending_count_ > 0 || stopping_;
+        });
+        if (pending_count_ == 0 && stopping_)
+        {
+            return;
+        }
+    }
+}
+
+bool TaskScheduler::TryPop(size_t worker_index, Task& task)
+{
+    auto take = [this, &task](std::deque<Task>& tasks, bool from_back) {
+        if (tasks.empty())
+        {
+            return false;
+        }
+        if (from_back)
+        {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        --pending_count_;
+        return true;
+    };
+
+    {
+        auto& worker = *workers_[worker_index];
+        std::lock_guard guard(worker.mutex);
+        if (take(worker.tasks, true))
+        {
+            return true;
+        }
+    }
+
+    {
+        std::lock_guard guard(shared_mutex_);
+        if (take(shared_tasks_, false))
+        {
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < workers_.size(); ++i)
+    {
+        auto& victim = *workers_[(worker_index + i) % workers_.size()];
+        std::lock_guard guard(victim.mutex);
+        if (take(victim.tasks, false))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace transport
+{
+    // Пул потоков с перехватом работы. Задачи, поставленные извне, попадают в общую очередь и берутся
+    // в порядке постановки; задачи, поставленные из рабочего потока, — в его собственную очередь, откуда
+    // он берёт последнюю, а простаивающие потоки забирают самую раннюю. Так подзадачи большой задачи
+    // расходятся по свободным потокам, пока остальные заняты своими. Задачи не должны бросать исключений
+    class TaskScheduler
+    {
+    public:
+        using Task = std::function<void()>;
+
+        // 0 — по числу ядер
+        explicit TaskScheduler(size_t worker_count = 0);
+
+        // Дожидается выполнения всех поставленных задач
+        ~TaskScheduler();
+
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+        void Submit(Task task);
+
+        size_t GetWorkerCount() const;
+
+        // Делит [0, count) на chunk_count кусков и вызывает func(first, last) для каждого в вызывающем
+        // и в свободных рабочих потоках. Вызывающий поток сам берёт куски, пока они есть, поэтому вызов
+        // из рабочего потока не зависает, даже если остальные заняты. Возвращается, когда выполнены все
+        // куски; первое исключение из func пробрасывается
+        void ForEachChunk(size_t count, size_t chunk_count, const std::function<void(size_t, size_t)>& func);
+
+        // Планировщик, в рабочем потоке которого выполняется вызов, или nullptr
+        static TaskScheduler* GetCurrent();
+
+    private:
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void Run(size_t worker_index);
+
+        bool TryPop(size_t worker_index, Task& task);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::mutex shared_mutex_;
+        std::deque<Task> shared_tasks_;
+        // Поставленные, но ещё не взятые задачи; по нему засыпают и просыпаются рабочие потоки
+        std::atomic<size_t> pending_count_{0};
+        std::mutex sleep_mutex_;
+        std::condition_variable wake_;
+        bool stopping_ = false;
+        std::vector<std::thread> threads_;
+    };
+}
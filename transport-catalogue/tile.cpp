@@ -0,0 +1,77 @@
+#include "tile.h"
+#include <cmath>
+#include <sstream>
+
+using namespace std::literals;
+
+namespace tile {
+
+    Writer::Writer(double width, double height, int precision)
+            : scale_(std::pow(10.0, precision)) {
+        data_ += "TCT"sv;
+        data_.push_back(static_cast<char>(FORMAT_VERSION));
+        PutVarint(precision);
+        PutVarint(Scale(width));
+        PutVarint(Scale(height));
+    }
+
+    Writer& Writer::SetPalette(const std::vector<svg::Color>& colors) {
+        PutVarint(colors.size());
+        for (const auto& color : colors) {
+            std::ostringstream out;
+            out << color;
+            AddString(out.str());
+        }
+        return *this;
+    }
+
+    Writer& Writer::BeginLayer(LayerType type, size_t object_count) {
+        data_.push_back(static_cast<char>(type));
+        PutVarint(object_count);
+        cursor_x_ = 0;
+        cursor_y_ = 0;
+        return *this;
+    }
+
+    Writer& Writer::AddUint(uint64_t value) {
+        PutVarint(value);
+        return *this;
+    }
+
+    Writer& Writer::AddString(std::string_view value) {
+        PutVarint(value.size());
+        data_ += value;
+        return *this;
+    }
+
+    Writer& Writer::AddPoint(svg::Point point) {
+        const int64_t x = Scale(point.x);
+        const int64_t y = Scale(point.y);
+        PutSigned(x - cursor_x_);
+        PutSigned(y - cursor_y_);
+        cursor_x_ = x;
+        cursor_y_ = y;
+        return *this;
+    }
+
+    const std::string& Writer::GetData() const {
+        return data_;
+    }
+
+    void Writer::PutVarint(uint64_t value) {
+        while (value >= 0x80) {
+            data_.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        data_.push_back(static_cast<char>(value));
+    }
+
+    void Writer::PutSigned(int64_t value) {
+        PutVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    int64_t Writer::Scale(double value) const {
+        return std::llround(value * scale_);
+    }
+
+}  // namespace tile
@@ -0,0 +1,56 @@
+#pragma once
+#include "svg.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tile {
+
+    // Бинарный векторный тайл — компактная альтернатива SVG для клиентов, которые сами растеризуют карту.
+    //
+    // Формат (все целые — беззнаковые varint, координаты — zigzag varint):
+    //   "TCT" версия(1 байт)
+    //   масштаб: число знаков после запятой, с которым хранятся координаты
+    //   ширина и высота изображения в масштабированных единицах
+    //   палитра: число цветов, затем каждый цвет строкой в CSS-записи
+    //   слои: тип слоя (1 байт), число объектов, объекты слоя
+    // Строка — длина и байты. Точки хранятся как разности с предыдущей точкой слоя, в начале слоя курсор равен (0, 0).
+    enum class LayerType : uint8_t {
+        // индекс цвета, число точек, точки ломаной
+        ROUTES = 1,
+        // индекс цвета, название, число опорных точек, опорные точки
+        BUS_LABELS = 2,
+        // название, точка остановки (она же опорная точка подписи)
+        STOPS = 3,
+    };
+
+    inline constexpr uint8_t FORMAT_VERSION = 1;
+
+    class Writer {
+    public:
+        Writer(double width, double height, int precision);
+
+        Writer& SetPalette(const std::vector<svg::Color>& colors);
+
+        // Начинает новый слой и сбрасывает курсор разностного кодирования точек
+        Writer& BeginLayer(LayerType type, size_t object_count);
+
+        Writer& AddUint(uint64_t value);
+        Writer& AddString(std::string_view value);
+        Writer& AddPoint(svg::Point point);
+
+        const std::string& GetData() const;
+
+    private:
+        void PutVarint(uint64_t value);
+        void PutSigned(int64_t value);
+        int64_t Scale(double value) const;
+
+        double scale_ = 1.0;
+        int64_t cursor_x_ = 0;
+        int64_t cursor_y_ = 0;
+        std::string data_;
+    };
+
+}  // namespace tile
@@ -1,92 +1,919 @@
 #include "transport_catalogue.h"
 #include "geo.h"
+#include "parallel.h"
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_set>
+
+using namespace std::string_literals;
 
 namespace transport {
 
+    namespace {
+        // Сливает упорядоченные по названиям списки автобусов остановки: старый без удалённых автобусов
+        // и новый без повторов, которые у одного автобуса идут подряд. Без out только считает размер
+        size_t MergeStopBuses(const uint32_t* old_it, const uint32_t* old_last,
+                              const uint32_t* added_it, const uint32_t* added_last,
+                              const std::vector<bool>& is_removed, const std::vector<std::string_view>& bus_names,
+                              uint32_t* out) {
+            const uint32_t* added_first = added_it;
+            size_t count = 0;
+            while (old_it != old_last || added_it != added_last) {
+                if (old_it != old_last && is_removed[*old_it]) {
+                    ++old_it;
+                    continue;
+                }
+                if (added_it != added_last && added_it != added_first && *added_it == *(added_it - 1)) {
+                    ++added_it;
+                    continue;
+                }
+
+                const bool take_old = added_it == added_last
+                        || (old_it != old_last && bus_names[*old_it] < bus_names[*added_it]);
+                const uint32_t bus_id = take_old ? *old_it++ : *added_it++;
+                if (out) {
+                    out[count] = bus_id;
+                }
+                ++count;
+            }
+            return count;
+        }
+    }
+
+    void Catalogue::Reserve(size_t stop_count, size_t distance_count) {
+        auto& stops = stops_.Write();
+        stops.reserve(stops.size() + stop_count);
+        auto& stopname_to_stop = stopname_to_stop_.Write();
+        stopname_to_stop.reserve(stopname_to_stop.size() + stop_count);
+        if (auto* stop_buses = stop_to_buses_.Write()) {
+            stop_buses->offsets.reserve(stop_buses->offsets.size() + stop_count);
+        }
+        auto& distances = stopidpair_to_distance.Write();
+        distances.reserve(distances.size() + distance_count);
+    }
+
     void Catalogue::AddStop(std::string name, Coordinates coordinates) {
-        stops_.push_back({std::move(name), std::move(coordinates)});
-        Stop& ref = *(stops_.end() - 1);
-        stopname_to_stop_[ref.name] = &ref;
-        stop_to_buses_names[&ref];
+        auto& stops = stops_.Write();
+        stops.push_back(std::make_shared<const Stop>(Stop{std::move(name), std::move(coordinates), stops.size()}));
+        const Stop* stop_ptr = stops.back().get();
+        stopname_to_stop_.Write()[stop_ptr->name] = stop_ptr;
+        frozen_names_.reset();
+        if (auto* geometry = stop_geometry_.Write()) {
+            geometry->Set(stop_ptr->id, stop_ptr->coordinates);
+        }
+        if (auto* stop_buses = stop_to_buses_.Write()) {
+            stop_buses->offsets.push_back(stop_buses->offsets.back());
+        }
+        IncrementVersion();
+    }
+
+    void Catalogue::UpdateStop(std::string_view name, Coordinates coordinates) {
+        const Stop* old_stop_ptr = stopname_to_stop_->at(name);
+        auto stop = std::make_shared<const Stop>(Stop{old_stop_ptr->name, std::move(coordinates), old_stop_ptr->id});
+
+        // Ключ ссылается на имя в старом объекте, поэтому запись пересоздаётся
+        auto& stopname_to_stop = stopname_to_stop_.Write();
+        stopname_to_stop.erase(name);
+        stopname_to_stop[stop->name] = stop.get();
+        const size_t stop_id = stop->id;
+        if (auto* geometry = stop_geometry_.Write()) {
+            geometry->Set(stop_id, stop->coordinates);
+        }
+        stops_.Write()[stop_id] = std::move(stop);
+        UpdateRouteStats(stop_id);
+        IncrementVersion();
+    }
+
+    void Catalogue::RemoveStop(std::string_view name) {
+        const Stop* stop_ptr = stopname_to_stop_->at(name);
+        if (!GetStopBuses(stop_ptr->id).empty()) {
+            throw std::logic_error("Stop "s + stop_ptr->name + " is used by buses"s);
+        }
+
+        // Расстояния до удалённой остановки не удаляются: её Stop::id больше никому не достанется
+        const size_t stop_id = stop_ptr->id;
+        stopname_to_stop_.Write().erase(name);
+        stops_.Write()[stop_id] = nullptr;
+        frozen_names_.reset();
+        IncrementVersion();
     }
 
     void Catalogue::SetStopsDistance(std::string_view stop_name_from, std::string_view stop_name_to, int distance) {
-        std::pair<const Stop*, const Stop*> stop_ptr_pair{stopname_to_stop_.at(stop_name_from), stopname_to_stop_.at(stop_name_to)};
-        stopptrpair_to_distance[stop_ptr_pair] = distance;
+        std::pair<size_t, size_t> stop_id_pair{stopname_to_stop_->at(stop_name_from)->id, stopname_to_stop_->at(stop_name_to)->id};
+        stopidpair_to_distance.Write()[stop_id_pair] = distance;
+        UpdateRouteStats(stop_id_pair.first);
+        IncrementVersion();
     }
 
-    void Catalogue::AddBus(std::string name, const std::vector<std::string_view>& stops_names, bool is_roundtrip) {
-        buses_.push_back({std::move(name), is_roundtrip, {}});
-        Bus& ref = *(buses_.end() - 1);
+    void Catalogue::RemoveStopsDistance(std::string_view stop_name_from, std::string_view stop_name_to) {
+        std::pair<size_t, size_t> stop_id_pair{stopname_to_stop_->at(stop_name_from)->id, stopname_to_stop_->at(stop_name_to)->id};
+        stopidpair_to_distance.Write().erase(stop_id_pair);
+        UpdateRouteStats(stop_id_pair.first);
+        IncrementVersion();
+    }
 
-        ref.bus_stops.reserve(stops_names.size());
+    void Catalogue::AddBus(std::string name, const std::vector<std::string_view>& stops_names, bool is_roundtrip) {
+        std::vector<size_t> stop_ids;
+        stop_ids.reserve(stops_names.size());
         for (const auto& stop_name : stops_names) {
-            const Stop* stop_ptr = stopname_to_stop_.at(stop_name);
-            ref.bus_stops.push_back(stop_ptr);
-            stop_to_buses_names[stop_ptr].insert(ref.name);
+            stop_ids.push_back(stopname_to_stop_->at(stop_name)->id);
         }
 
-        busname_to_bus_[ref.name] = &ref;
+        AddBusWithStops(std::move(name), std::move(stop_ids), is_roundtrip);
     }
 
-    std::optional<BusInfo> Catalogue::FindBus(std::string_view name_view) const {
-        if (!busname_to_bus_.count(name_view)) {
-            return {};
+    void Catalogue::AddBusWithStops(std::string name, std::vector<size_t> stop_ids, bool is_roundtrip) {
+        std::vector<std::shared_ptr<const Bus>> removed_buses;
+        if (busname_to_bus_->count(name)) {
+            removed_buses.push_back(UnregisterBus(name));
         }
 
-        const Bus* bus_ptr = busname_to_bus_.at(name_view);
-        std::set<const Stop*> unique_stops_set;
-        for (auto it = bus_ptr->bus_stops.begin(); it != bus_ptr->bus_stops.end(); ++it) {
-            unique_stops_set.insert(*it);
+        const Bus* bus_ptr = RegisterBus(std::move(name), std::move(stop_ids), is_roundtrip);
+        UpdateStopBuses(removed_buses, {bus_ptr});
+        IncrementVersion();
+    }
+
+    void Catalogue::AddBuses(const std::vector<BusInput>& buses) {
+        // Из маршрутов с одинаковым названием остаётся последний, как при добавлении по одному
+        std::unordered_map<std::string_view, size_t> last_by_name;
+        last_by_name.reserve(buses.size());
+        for (size_t i = 0; i < buses.size(); ++i) {
+            last_by_name[buses[i].name] = i;
         }
 
-        int route_length = 0;
-        double geo_length = 0.0;
-        for (auto it = bus_ptr->bus_stops.begin(); it != bus_ptr->bus_stops.end() - 1; ++it) {
-            geo_length += ComputeDistance((*it)->coordinates, (*(it + 1))->coordinates);
-            if (stopptrpair_to_distance.count(std::make_pair(*it, *(it + 1)))) {
-                route_length += stopptrpair_to_distance.at(std::make_pair(*it, *(it + 1)));
+        // Справочник меняется только после того, как все названия разрешились без ошибок
+        const auto& stopname_to_stop = *stopname_to_stop_;
+        std::vector<std::vector<size_t>> stop_ids(buses.size());
+        ParallelFor(buses.size(), [&](size_t i) {
+            stop_ids[i].reserve(buses[i].stops_names.size());
+            for (const auto stop_name : buses[i].stops_names) {
+                stop_ids[i].push_back(stopname_to_stop.at(stop_name)->id);
+            }
+        });
+
+        std::vector<std::shared_ptr<const Bus>> removed_buses;
+        std::vector<const Bus*> added_buses;
+        added_buses.reserve(last_by_name.size());
+        for (size_t i = 0; i < buses.size(); ++i) {
+            if (last_by_name.at(buses[i].name) != i) {
+                continue;
+            }
+            if (busname_to_bus_->count(buses[i].name)) {
+                removed_buses.push_back(UnregisterBus(buses[i].name));
+            }
+            added_buses.push_back(RegisterBus(buses[i].name, std::move(stop_ids[i]), buses[i].is_roundtrip,
+                                              buses[i].departures));
+        }
+
+        UpdateStopBuses(removed_buses, std::move(added_buses));
+        IncrementVersion();
+    }
+
+    void Catalogue::RemoveBus(std::string_view name) {
+        UpdateStopBuses({UnregisterBus(name)}, {});
+        IncrementVersion();
+    }
+
+    const Bus* Catalogue::RegisterBus(std::string name, std::vector<size_t> stop_ids, bool is_roundtrip,
+                                      std::vector<double> departures) {
+        std::sort(departures.begin(), departures.end());
+        auto& bus_names = bus_names_.Write();
+        auto bus = std::make_shared<const Bus>(Bus{std::move(name), is_roundtrip, std::move(stop_ids), bus_names.size(),
+                                                   std::move(departures)});
+        const Bus* bus_ptr = bus.get();
+        bus_names.push_back(bus_ptr->name);
+        busname_to_bus_.Write()[bus_ptr->name] = std::move(bus);
+        frozen_names_.reset();
+        incidence_.Reset();
+
+        if (route_stats_.TryGet()) {
+            auto& route_stats = *route_stats_.Write();
+            route_stats.resize(bus_names.size());
+            route_stats[bus_ptr->id] = ComputeBusInfo(*bus_ptr);
+        }
+        return bus_ptr;
+    }
+
+    std::shared_ptr<const Bus> Catalogue::UnregisterBus(std::string_view name) {
+        auto& busname_to_bus = busname_to_bus_.Write();
+        const auto it = busname_to_bus.find(name);
+        if (it == busname_to_bus.end()) {
+            throw std::out_of_range("Bus "s + std::string{name} + " not found"s);
+        }
+
+        std::shared_ptr<const Bus> bus = it->second;
+        bus_names_.Write()[bus->id] = {};
+        busname_to_bus.erase(it);
+        frozen_names_.reset();
+        incidence_.Reset();
+        if (route_stats_.TryGet()) {
+            (*route_stats_.Write())[bus->id].reset();
+        }
+        return bus;
+    }
+
+    void Catalogue::UpdateStopBuses(const std::vector<std::shared_ptr<const Bus>>& removed_buses, std::vector<const Bus*> added_buses) {
+        if (!stop_to_buses_.TryGet()) {
+            return;
+        }
+
+        std::vector<bool> is_removed(bus_names_->size(), false);
+        size_t changed_count = 0;
+        for (const auto& bus : removed_buses) {
+            is_removed[bus->id] = true;
+            changed_count += bus->stop_ids.size();
+        }
+        for (const Bus* bus_ptr : added_buses) {
+            changed_count += bus_ptr->stop_ids.size();
+        }
+
+        if (changed_count == 0) {
+            return;
+        }
+
+        // Перестроить индекс целиком не дороже, чем слить его с большим изменением, поэтому
+        // это откладывается до первого запроса, которому индекс понадобится
+        if (changed_count * 8 >= stop_to_buses_.TryGet()->bus_ids.size()) {
+            stop_to_buses_.Reset();
+            return;
+        }
+
+        std::sort(added_buses.begin(), added_buses.end(), [](const Bus* lhs, const Bus* rhs) {
+            return lhs->name < rhs->name;
+        });
+        UpdateStopBusesInPlace(removed_buses, added_buses, is_removed);
+    }
+
+    void Catalogue::UpdateStopBusesInPlace(const std::vector<std::shared_ptr<const Bus>>& removed_buses,
+                                           const std::vector<const Bus*>& added_buses, const std::vector<bool>& is_removed) {
+        // Пары (остановка, автобус) новых маршрутов; устойчивая сортировка сохраняет порядок названий
+        std::vector<std::pair<size_t, uint32_t>> added_pairs;
+        std::vector<size_t> affected_stops;
+        for (const Bus* bus_ptr : added_buses) {
+            for (const size_t stop_id : bus_ptr->stop_ids) {
+                added_pairs.emplace_back(stop_id, uint32_t(bus_ptr->id));
+                affected_stops.push_back(stop_id);
+            }
+        }
+        for (const auto& bus : removed_buses) {
+            affected_stops.insert(affected_stops.end(), bus->stop_ids.begin(), bus->stop_ids.end());
+        }
+
+        std::stable_sort(added_pairs.begin(), added_pairs.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+        });
+        std::sort(affected_stops.begin(), affected_stops.end());
+        affected_stops.erase(std::unique(affected_stops.begin(), affected_stops.end()), affected_stops.end());
+
+        std::vector<uint32_t> added_ids(added_pairs.size());
+        std::transform(added_pairs.begin(), added_pairs.end(), added_ids.begin(), [](const auto& pair) {
+            return pair.second;
+        });
+
+        // Новые списки затронутых остановок собираются отдельно
+        const auto& bus_names = *bus_names_;
+        auto& index = *stop_to_buses_.Write();
+        std::vector<std::vector<uint32_t>> new_lists(affected_stops.size());
+        std::vector<size_t> old_sizes(affected_stops.size());
+        auto added_it = added_pairs.begin();
+        for (size_t i = 0; i < affected_stops.size(); ++i) {
+            const size_t stop_id = affected_stops[i];
+            const auto added_first = added_it;
+            while (added_it != added_pairs.end() && added_it->first == stop_id) {
+                ++added_it;
+            }
+
+            const uint32_t* old_first = index.bus_ids.data() + index.offsets[stop_id];
+            const uint32_t* old_last = index.bus_ids.data() + index.offsets[stop_id + 1];
+            const uint32_t* ids_first = added_ids.data() + (added_first - added_pairs.begin());
+            const uint32_t* ids_last = added_ids.data() + (added_it - added_pairs.begin());
+            old_sizes[i] = old_last - old_first;
+            new_lists[i].resize(MergeStopBuses(old_first, old_last, ids_first, ids_last, is_removed, bus_names, nullptr));
+            MergeStopBuses(old_first, old_last, ids_first, ids_last, is_removed, bus_names, new_lists[i].data());
+        }
+
+        // Куски между затронутыми остановками сдвигаются целиком. Итоговые куски не пересекаются и идут
+        // в прежнем порядке, поэтому сдвиги влево безопасно делать слева направо, а вправо — справа налево
+        struct Segment {
+            size_t first, last;
+            std::ptrdiff_t shift;
+        };
+        std::vector<Segment> segments;
+        std::ptrdiff_t shift = 0;
+        for (size_t i = 0; i < affected_stops.size(); ++i) {
+            const size_t stop_id = affected_stops[i];
+            shift += std::ptrdiff_t(new_lists[i].size()) - std::ptrdiff_t(old_sizes[i]);
+            const size_t next_first = i + 1 < affected_stops.size() ? index.offsets[affected_stops[i + 1]] : index.bus_ids.size();
+            segments.push_back({index.offsets[stop_id + 1], next_first, shift});
+        }
+
+        const size_t old_size = index.bus_ids.size();
+        const size_t new_size = size_t(std::ptrdiff_t(old_size) + shift);
+        if (new_size > old_size) {
+            index.bus_ids.resize(new_size);
+        }
+
+        uint32_t* data = index.bus_ids.data();
+        for (const Segment& segment : segments) {
+            if (segment.shift < 0) {
+                std::copy(data + segment.first, data + segment.last, data + segment.first + segment.shift);
+            }
+        }
+        for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+            if (it->shift > 0) {
+                std::copy_backward(data + it->first, data + it->last, data + it->last + it->shift);
+            }
+        }
+
+        // Списки затронутых остановок записываются на новые места, а следующие границы сдвигаются
+        // на накопленную разницу размеров
+        shift = 0;
+        for (size_t i = 0; i < affected_stops.size(); ++i) {
+            const size_t stop_id = affected_stops[i];
+            const size_t next_stop = i + 1 < affected_stops.size() ? affected_stops[i + 1] : index.offsets.size() - 1;
+            shift += std::ptrdiff_t(new_lists[i].size()) - std::ptrdiff_t(old_sizes[i]);
+            std::copy(new_lists[i].begin(), new_lists[i].end(), data + index.offsets[stop_id]);
+            for (size_t j = stop_id + 1; j <= next_stop; ++j) {
+                index.offsets[j] = uint32_t(std::ptrdiff_t(index.offsets[j]) + shift);
+            }
+        }
+
+        if (new_size < old_size) {
+            index.bus_ids.resize(new_size);
+        }
+    }
+
+    Catalogue::StopBusesIndex Catalogue::BuildStopBuses() const {
+        const size_t stop_count = stops_->size();
+        const auto& busname_to_bus = *busname_to_bus_;
+
+        // Пары (остановка, автобус) раскладываются подсчётом по остановкам. Автобусы перебираются
+        // в порядке названий, поэтому у каждой остановки они сразу упорядочены. Автобус, проходящий
+        // остановку несколько раз, учитывается при первом проходе
+        constexpr uint32_t NO_BUS = UINT32_MAX;
+        std::vector<uint32_t> last_bus(stop_count, NO_BUS);
+        StopBusesIndex index;
+        index.offsets.assign(stop_count + 1, 0);
+        for (const auto& [bus_name, bus] : busname_to_bus) {
+            for (const size_t stop_id : bus->stop_ids) {
+                if (last_bus[stop_id] != bus->id) {
+                    last_bus[stop_id] = uint32_t(bus->id);
+                    ++index.offsets[stop_id + 1];
+                }
+            }
+        }
+        std::partial_sum(index.offsets.begin(), index.offsets.end(), index.offsets.begin());
+
+        index.bus_ids.resize(index.offsets.back());
+        std::vector<uint32_t> cursors(index.offsets.begin(), index.offsets.end() - 1);
+        std::fill(last_bus.begin(), last_bus.end(), NO_BUS);
+        for (const auto& [bus_name, bus] : busname_to_bus) {
+            for (const size_t stop_id : bus->stop_ids) {
+                if (last_bus[stop_id] != bus->id) {
+                    last_bus[stop_id] = uint32_t(bus->id);
+                    index.bus_ids[cursors[stop_id]++] = uint32_t(bus->id);
+                }
+            }
+        }
+        return index;
+    }
+
+    BusNamesView Catalogue::GetStopBuses(size_t stop_id) const {
+        const auto& index = stop_to_buses_.Get([this] {
+            return BuildStopBuses();
+        });
+        const uint32_t* bus_ids = index.bus_ids.data();
+        return {bus_ids + index.offsets[stop_id], bus_ids + index.offsets[stop_id + 1], bus_names_->data()};
+    }
+
+    std::vector<std::string_view> Catalogue::GetCommonBuses(size_t stop_id_first, size_t stop_id_second) const {
+        const BusNamesView first = GetStopBuses(stop_id_first);
+        const BusNamesView second = GetStopBuses(stop_id_second);
+
+        std::vector<std::string_view> result;
+        std::set_intersection(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(result));
+        return result;
+    }
+
+    std::vector<std::string> Catalogue::ValidateDelta(const CatalogueDelta& delta) const {
+        std::vector<std::string> errors;
+
+        // Остановки добавляются раньше всего остального, поэтому доступны всем элементам пакета
+        std::unordered_set<std::string_view> added_stops;
+        for (const auto& stop_change : delta.stops) {
+            if (stop_change.coordinates && !stopname_to_stop_->count(stop_change.name)) {
+                added_stops.insert(stop_change.name);
+            }
+        }
+        auto has_stop = [this, &added_stops](std::string_view name) {
+            return stopname_to_stop_->count(name) > 0 || added_stops.count(name) > 0;
+        };
+        auto check_distance = [&errors, &has_stop](std::string_view from, std::string_view to) {
+            for (const std::string_view name : {from, to}) {
+                if (!has_stop(name)) {
+                    errors.push_back("Distance "s + std::string{from} + " - "s + std::string{to}
+                                     + ": stop "s + std::string{name} + " not found"s);
+                }
+            }
+        };
+
+        for (const auto& stop_change : delta.stops) {
+            for (const auto& [stop_name_to, distance] : stop_change.road_distances) {
+                check_distance(stop_change.name, stop_name_to);
+            }
+        }
+        for (const auto& distance_change : delta.distances) {
+            check_distance(distance_change.from, distance_change.to);
+        }
+
+        // Маршруты меняются по порядку, итоговый список остановок маршрута задаёт последний элемент
+        std::unordered_map<std::string_view, const std::vector<std::string>*> changed_routes;
+        for (const auto& bus_change : delta.buses) {
+            const auto it = changed_routes.find(bus_change.name);
+            const bool exists = it != changed_routes.end() ? it->second != nullptr : busname_to_bus_->count(bus_change.name) > 0;
+            if (!bus_change.stops) {
+                if (!exists) {
+                    errors.push_back("Bus "s + bus_change.name + " not found"s);
+                }
+                changed_routes[bus_change.name] = nullptr;
+                continue;
+            }
+
+            if (bus_change.stops->empty()) {
+                errors.push_back("Bus "s + bus_change.name + " has no stops"s);
+            }
+            for (const auto& stop_name : *bus_change.stops) {
+                if (!has_stop(stop_name)) {
+                    errors.push_back("Bus "s + bus_change.name + ": stop "s + stop_name + " not found"s);
+                }
+            }
+            changed_routes[bus_change.name] = &*bus_change.stops;
+        }
+
+        std::unordered_set<std::string_view> changed_route_stops;
+        for (const auto& [bus_name, stops] : changed_routes) {
+            if (stops) {
+                changed_route_stops.insert(stops->begin(), stops->end());
+            }
+        }
+
+        // Остановки удаляются последними, и к этому моменту через них не должен идти ни один маршрут
+        std::unordered_set<std::string_view> removed_stops;
+        for (const auto& stop_change : delta.stops) {
+            if (stop_change.coordinates) {
+                continue;
+            }
+            if (!has_stop(stop_change.name) || !removed_stops.insert(stop_change.name).second) {
+                errors.push_back("Stop "s + stop_change.name + " not found"s);
+                continue;
+            }
+
+            bool is_used = changed_route_stops.count(stop_change.name) > 0;
+            if (const auto it = stopname_to_stop_->find(stop_change.name); it != stopname_to_stop_->end()) {
+                for (const auto bus_name : GetStopBuses(it->second->id)) {
+                    is_used = is_used || !changed_routes.count(bus_name);
+                }
+            }
+            if (is_used) {
+                errors.push_back("Stop "s + stop_change.name + " is used by buses"s);
+            }
+        }
+
+        return errors;
+    }
+
+    DeltaReport Catalogue::ApplyDelta(const CatalogueDelta& delta) {
+        DeltaReport report;
+        report.errors = ValidateDelta(delta);
+        if (!report.errors.empty()) {
+            return report;
+        }
+
+        auto mark_stop_buses = [this, &report](size_t stop_id) {
+            for (const auto bus_name : GetStopBuses(stop_id)) {
+                report.buses.emplace(bus_name);
+            }
+        };
+        auto mark_distance = [this, &report](std::string_view stop_name_from, std::string_view stop_name_to) {
+            const size_t stop_id_from = stopname_to_stop_->at(stop_name_from)->id;
+            const size_t stop_id_to = stopname_to_stop_->at(stop_name_to)->id;
+            for (const auto bus_name : GetCommonBuses(stop_id_from, stop_id_to)) {
+                report.buses.emplace(bus_name);
+            }
+        };
+        auto mark_bus = [this, &report](std::string_view bus_name) {
+            const auto it = busname_to_bus_->find(bus_name);
+            if (it == busname_to_bus_->end()) {
+                return;
+            }
+            report.buses.emplace(bus_name);
+            for (const size_t stop_id : it->second->stop_ids) {
+                report.stops.emplace((*stops_)[stop_id]->name);
+            }
+            report.map_changed = true;
+        };
+
+        for (const auto& stop_change : delta.stops) {
+            if (!stop_change.coordinates) {
+                continue;
+            }
+
+            const auto it = stopname_to_stop_->find(stop_change.name);
+            if (it == stopname_to_stop_->end()) {
+                AddStop(stop_change.name, *stop_change.coordinates);
             }
             else {
-                route_length += stopptrpair_to_distance.at(std::make_pair(*(it + 1), *it));
+                const size_t stop_id = it->second->id;
+                UpdateStop(stop_change.name, *stop_change.coordinates);
+                if (!GetStopBuses(stop_id).empty()) {
+                    mark_stop_buses(stop_id);
+                    report.map_changed = true;
+                }
+            }
+            report.stops.insert(stop_change.name);
+        }
+
+        for (const auto& stop_change : delta.stops) {
+            for (const auto& [stop_name_to, distance] : stop_change.road_distances) {
+                SetStopsDistance(stop_change.name, stop_name_to, distance);
+                mark_distance(stop_change.name, stop_name_to);
             }
         }
 
-        if (!bus_ptr->is_roundtrip) {
-            for (auto it = bus_ptr->bus_stops.rbegin(); it != bus_ptr->bus_stops.rend() - 1; ++it) {
-                geo_length += ComputeDistance((*it)->coordinates, (*(it + 1))->coordinates);
-                if (stopptrpair_to_distance.count(std::make_pair(*it, *(it + 1)))) {
-                    route_length += stopptrpair_to_distance.at(std::make_pair(*it, *(it + 1)));
+        for (const auto& distance_change : delta.distances) {
+            if (distance_change.distance) {
+                SetStopsDistance(distance_change.from, distance_change.to, *distance_change.distance);
+            }
+            else {
+                RemoveStopsDistance(distance_change.from, distance_change.to);
+            }
+            mark_distance(distance_change.from, distance_change.to);
+        }
+
+        // Индекс автобусов остановок перестраивается один раз на все изменения маршрутов
+        const size_t first_new_bus_id = bus_names_->size();
+        std::vector<std::shared_ptr<const Bus>> removed_buses;
+        std::vector<const Bus*> added_buses;
+        for (const auto& bus_change : delta.buses) {
+            mark_bus(bus_change.name);
+            if (busname_to_bus_->count(bus_change.name) || !bus_change.stops) {
+                auto bus = UnregisterBus(bus_change.name);
+                if (bus->id < first_new_bus_id) {
+                    removed_buses.push_back(std::move(bus));
                 }
                 else {
-                    route_length += stopptrpair_to_distance.at(std::make_pair(*(it + 1), *it));
+                    added_buses.erase(std::find(added_buses.begin(), added_buses.end(), bus.get()));
+                }
+            }
+            if (!bus_change.stops) {
+                continue;
+            }
+
+            std::vector<size_t> stop_ids;
+            stop_ids.reserve(bus_change.stops->size());
+            for (const auto& stop_name : *bus_change.stops) {
+                stop_ids.push_back(stopname_to_stop_->at(stop_name)->id);
+            }
+            added_buses.push_back(RegisterBus(bus_change.name, std::move(stop_ids), bus_change.is_roundtrip,
+                                              bus_change.departures));
+            mark_bus(bus_change.name);
+        }
+        UpdateStopBuses(removed_buses, std::move(added_buses));
+        IncrementVersion();
+
+        for (const auto& stop_change : delta.stops) {
+            if (!stop_change.coordinates) {
+                RemoveStop(stop_change.name);
+                report.stops.insert(stop_change.name);
+            }
+        }
+
+        return report;
+    }
+
+    std::optional<BusInfo> Catalogue::ComputeBusInfo(const Bus& bus) const {
+        const auto& stops = *stops_;
+        const StopGeometry* geometry = compact_geometry_ ? &GetStopGeometry() : nullptr;
+        std::set<size_t> unique_stops_set(bus.stop_ids.begin(), bus.stop_ids.end());
+
+        auto get_geo_distance = [&stops, geometry](size_t stop_id_from, size_t stop_id_to) {
+            return geometry ? geometry->ComputeDistance(stop_id_from, stop_id_to)
+                            : ComputeDistance(stops[stop_id_from]->coordinates, stops[stop_id_to]->coordinates);
+        };
+
+        int route_length = 0;
+        double geo_length = 0.0;
+        for (auto it = bus.stop_ids.begin(); it != bus.stop_ids.end() - 1; ++it) {
+            geo_length += get_geo_distance(*it, *(it + 1));
+            const auto distance = Catalogue::GetDistance(*it, *(it + 1));
+            if (!distance) {
+                return std::nullopt;
+            }
+            route_length += *distance;
+        }
+
+        if (!bus.is_roundtrip) {
+            for (auto it = bus.stop_ids.rbegin(); it != bus.stop_ids.rend() - 1; ++it) {
+                geo_length += get_geo_distance(*it, *(it + 1));
+                const auto distance = Catalogue::GetDistance(*it, *(it + 1));
+                if (!distance) {
+                    return std::nullopt;
                 }
+                route_length += *distance;
             }
         }
 
-        int stops_on_route = bus_ptr->is_roundtrip
-                ? bus_ptr->bus_stops.size()
-                : bus_ptr->bus_stops.size() * 2 - 1;
+        int stops_on_route = bus.is_roundtrip
+                ? bus.stop_ids.size()
+                : bus.stop_ids.size() * 2 - 1;
 
         double curvature = route_length / geo_length;
-        return BusInfo{bus_ptr->name, stops_on_route, int(unique_stops_set.size()), route_length, curvature};
+        return BusInfo{bus.name, stops_on_route, int(unique_stops_set.size()), route_length, curvature};
+    }
+
+    std::vector<std::optional<BusInfo>> Catalogue::BuildRouteStats() const {
+        std::vector<const Bus*> buses;
+        buses.reserve(busname_to_bus_->size());
+        for (const auto& [bus_name, bus] : *busname_to_bus_) {
+            buses.push_back(bus.get());
+        }
+
+        std::vector<std::optional<BusInfo>> route_stats(bus_names_->size());
+        ParallelFor(buses.size(), [&](size_t i) {
+            route_stats[buses[i]->id] = ComputeBusInfo(*buses[i]);
+        });
+        return route_stats;
+    }
+
+    StopGeometry Catalogue::BuildStopGeometry() const {
+        const auto& stops = *stops_;
+        StopGeometry geometry;
+        geometry.coordinates.resize(stops.size());
+        geometry.unit_vectors.resize(stops.size());
+        ParallelFor(stops.size(), [&](size_t stop_id) {
+            if (stops[stop_id]) {
+                geometry.Set(stop_id, stops[stop_id]->coordinates);
+            }
+        });
+        return geometry;
+    }
+
+    void Catalogue::UpdateRouteStats(size_t stop_id) {
+        if (!route_stats_.TryGet()) {
+            return;
+        }
+
+        auto& route_stats = *route_stats_.Write();
+        const auto& busname_to_bus = *busname_to_bus_;
+        for (const auto bus_name : GetStopBuses(stop_id)) {
+            const Bus& bus = *busname_to_bus.at(bus_name);
+            route_stats[bus.id] = ComputeBusInfo(bus);
+        }
+    }
+
+    void Catalogue::Freeze() {
+        auto frozen_names = std::make_shared<FrozenNames>();
+
+        std::vector<std::optional<std::string_view>> stop_names(stops_->size());
+        for (size_t stop_id = 0; stop_id < stop_names.size(); ++stop_id) {
+            if (const auto& stop = (*stops_)[stop_id]) {
+                stop_names[stop_id] = stop->name;
+            }
+        }
+        frozen_names->stops = PerfectNameIndex(stop_names);
+
+        std::vector<std::optional<std::string_view>> bus_names;
+        bus_names.reserve(busname_to_bus_->size());
+        frozen_names->sorted_buses.reserve(busname_to_bus_->size());
+        for (const auto& [bus_name, bus] : *busname_to_bus_) {
+            bus_names.push_back(bus_name);
+            frozen_names->sorted_buses.push_back(bus.get());
+        }
+        frozen_names->buses = PerfectNameIndex(bus_names);
+
+        frozen_names_ = std::move(frozen_names);
+    }
+
+    void Catalogue::SetCompactGeometry(bool compact_geometry) {
+        if (compact_geometry_ != compact_geometry) {
+            compact_geometry_ = compact_geometry;
+            route_stats_.Reset();
+        }
+    }
+
+    const StopGeometry& Catalogue::GetStopGeometry() const {
+        return stop_geometry_.Get([this] {
+            return BuildStopGeometry();
+        });
+    }
+
+    const Stop* Catalogue::FindStopPtr(std::string_view name) const {
+        if (frozen_names_) {
+            const auto stop_id = frozen_names_->stops.FindCandidate(name);
+            const Stop* stop_ptr = stop_id ? (*stops_)[*stop_id].get() : nullptr;
+            return stop_ptr && stop_ptr->name == name ? stop_ptr : nullptr;
+        }
+
+        const auto it = stopname_to_stop_->find(name);
+        return it != stopname_to_stop_->end() ? it->second : nullptr;
+    }
+
+    const Bus* Catalogue::FindBusPtr(std::string_view name) const {
+        if (frozen_names_) {
+            const auto position = frozen_names_->buses.FindCandidate(name);
+            const Bus* bus_ptr = position ? frozen_names_->sorted_buses[*position] : nullptr;
+            return bus_ptr && bus_ptr->name == name ? bus_ptr : nullptr;
+        }
+
+        const auto it = busname_to_bus_->find(name);
+        return it != busname_to_bus_->end() ? it->second.get() : nullptr;
+    }
+
+    std::optional<BusInfo> Catalogue::FindBus(std::string_view name_view) const {
+        const Bus* bus_ptr = FindBusPtr(name_view);
+        if (!bus_ptr) {
+            return {};
+        }
+
+        const auto& route_stats = route_stats_.Get([this] {
+            return BuildRouteStats();
+        });
+        const auto& bus_info = route_stats[bus_ptr->id];
+        if (!bus_info) {
+            throw std::out_of_range("Bus "s + std::string{name_view} + " has no road distance between some stops"s);
+        }
+        return bus_info;
     }
 
     std::optional<StopInfo> Catalogue::FindStop(std::string_view name_view) const {
-        if (!stopname_to_stop_.count(name_view)) {
+        const Stop* stop_ptr = FindStopPtr(name_view);
+        if (!stop_ptr) {
             return {};
         }
 
-        const Stop* stop_ptr = stopname_to_stop_.at(name_view);
-        return StopInfo{stop_ptr->name, stop_to_buses_names.at(stop_ptr)};
+        return StopInfo{stop_ptr->name, GetStopBuses(stop_ptr->id), stop_ptr->id};
+    }
+
+    const std::vector<std::shared_ptr<const Stop>>& Catalogue::GetStops() const {
+        return *stops_;
+    }
+
+    const std::map<std::string_view, std::shared_ptr<const Bus>>& Catalogue::GetBuses() const {
+        return *busname_to_bus_;
+    }
+
+    const Catalogue::DistanceTable& Catalogue::GetDistances() const {
+        return *stopidpair_to_distance;
+    }
+
+    uint64_t Catalogue::GetVersion() const {
+        return version_;
+    }
+
+    void Catalogue::IncrementVersion() {
+        ++version_;
+        network_stats_.Reset();
+    }
+
+    std::vector<IndexBuildStats> Catalogue::GetIndexStats() const {
+        return {stop_to_buses_.GetStats(), route_stats_.GetStats(), stop_geometry_.GetStats(), network_stats_.GetStats(), incidence_.GetStats()};
+    }
+
+    size_t Catalogue::GetStopCount() const {
+        return stops_->size();
+    }
+
+    std::string_view Catalogue::GetStopName(size_t stop_id) const {
+        return (*stops_)[stop_id]->name;
+    }
+
+    Coordinates Catalogue::GetStopCoordinates(size_t stop_id) const {
+        return (*stops_)[stop_id]->coordinates;
+    }
+
+    std::optional<int> Catalogue::GetDistance(size_t stop_id_from, size_t stop_id_to) const {
+        const auto& distances = *stopidpair_to_distance;
+        if (const auto it = distances.find({stop_id_from, stop_id_to}); it != distances.end()) {
+            return it->second;
+        }
+        if (const auto it = distances.find({stop_id_to, stop_id_from}); it != distances.end()) {
+            return it->second;
+        }
+        return std::nullopt;
+    }
+
+    void Catalogue::ForEachRoute(const std::function<void(Route)>& callback) const {
+        if (frozen_names_) {
+            for (const Bus* bus_ptr : frozen_names_->sorted_buses) {
+                callback(Route{bus_ptr->name, bus_ptr->is_roundtrip, bus_ptr->stop_ids, bus_ptr->departures});
+            }
+            return;
+        }
+
+        for (const auto& [bus_name, bus_ptr] : *busname_to_bus_) {
+            Route route{bus_name, bus_ptr->is_roundtrip, bus_ptr->stop_ids, bus_ptr->departures};
+            callback(std::move(route));
+        }
+    }
+
+    const NetworkStats& Catalogue::GetNetworkStats() const {
+        return network_stats_.Get([this] {
+            return BuildNetworkStats();
+        });
+    }
+
+    const StopBusIncidence& Catalogue::GetIncidence() const {
+        return incidence_.Get([this] {
+            return StopBusIncidence(*this);
+        });
+    }
+
+    NetworkStats Catalogue::BuildNetworkStats() const {
+        const auto& route_stats = route_stats_.Get([this] {
+            return BuildRouteStats();
+        });
+        std::vector<BusInfo> buses;
+        buses.reserve(busname_to_bus_->size());
+        for (const auto& [bus_name, bus] : *busname_to_bus_) {
+            if (const auto& bus_info = route_stats[bus->id]) {
+                buses.push_back(*bus_info);
+            }
+        }
+
+        const auto& stops = *stops_;
+        std::vector<size_t> bus_counts(stops.size());
+        ParallelFor(stops.size(), [&](size_t stop_id) {
+            bus_counts[stop_id] = stops[stop_id] ? GetStopBuses(stop_id).size() : 0;
+        });
+
+        std::vector<NetworkStats::StopRank> served_stops;
+        for (size_t stop_id = 0; stop_id < stops.size(); ++stop_id) {
+            if (bus_counts[stop_id] > 0) {
+                served_stops.push_back({stops[stop_id]->name, bus_counts[stop_id]});
+            }
+        }
+
+        return MakeNetworkStats(std::move(buses), std::move(served_stops), busname_to_bus_->size(), stopname_to_stop_->size());
+    }
+
+    NetworkStats MakeNetworkStats(std::vector<BusInfo> buses, std::vector<NetworkStats::StopRank> served_stops,
+                                  size_t bus_count, size_t stop_count) {
+        NetworkStats stats;
+        stats.bus_count = bus_count;
+        stats.stop_count = stop_count;
+        for (const BusInfo& bus_info : buses) {
+            stats.total_route_length += bus_info.route_length;
+            stats.total_stops_on_route += bus_info.stops_on_route;
+        }
+
+        stats.buses = std::move(buses);
+        stats.stops_by_bus_count = std::move(served_stops);
+        stats.buses_by_length.resize(stats.buses.size());
+        std::iota(stats.buses_by_length.begin(), stats.buses_by_length.end(), 0);
+        stats.buses_by_curvature = stats.buses_by_length;
+
+        // Три рейтинга независимы и сортируются одновременно. Индексы в buses идут в порядке названий,
+        // поэтому при равенстве меньший индекс означает меньшее название
+        const auto& bus_infos = stats.buses;
+        ParallelFor(3, [&](size_t ranking) {
+            if (ranking == 0) {
+                std::sort(stats.buses_by_length.begin(), stats.buses_by_length.end(), [&bus_infos](uint32_t lhs, uint32_t rhs) {
+                    return std::make_pair(-bus_infos[lhs].route_length, lhs) < std::make_pair(-bus_infos[rhs].route_length, rhs);
+                });
+            }
+            else if (ranking == 1) {
+                std::sort(stats.buses_by_curvature.begin(), stats.buses_by_curvature.end(), [&bus_infos](uint32_t lhs, uint32_t rhs) {
+                    return std::make_pair(-bus_infos[lhs].curvature, lhs) < std::make_pair(-bus_infos[rhs].curvature, rhs);
+                });
+            }
+            else {
+                std::sort(stats.stops_by_bus_count.begin(), stats.stops_by_bus_count.end(), [](const auto& lhs, const auto& rhs) {
+                    return std::make_pair(rhs.bus_count, lhs.name) < std::make_pair(lhs.bus_count, rhs.name);
+                });
+            }
+        });
+        return stats;
+    }
+
+    VersionedCatalogue::VersionedCatalogue()
+        : current_(std::make_shared<const Catalogue>()) {
+    }
+
+    VersionedCatalogue::VersionedCatalogue(Catalogue catalogue)
+        : current_(std::make_shared<const Catalogue>(std::move(catalogue))) {
     }
 
-    const std::deque<Stop>& Catalogue::GetStops() const {
-        return stops_;
+    std::shared_ptr<const Catalogue> VersionedCatalogue::Get() const {
+        return std::atomic_load(&current_);
     }
 
-    const std::map<std::string_view, const Bus*>& Catalogue::GetBuses() const {
-        return busname_to_bus_;
+    void VersionedCatalogue::Update(const std::function<void(Catalogue&)>& update) {
+        std::lock_guard guard(writer_mutex_);
+        auto next = std::make_shared<Catalogue>(*Get());
+        update(*next);
+        std::atomic_store(&current_, std::shared_ptr<const Catalogue>(std::move(next)));
     }
 
 }
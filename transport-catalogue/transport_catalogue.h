@@ -1,38 +1,184 @@
 #pragma once
 #include "domain.h"
 #include "geo.h"
+#include "name_index.h"
+#include "incidence.h"
 #include <string>
 #include <string_view>
-#include <deque>
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
-#include <set>
 #include <optional>
+#include <functional>
+#include <chrono>
+#include <cstdint>
 
 namespace transport {
 
-    class Catalogue {
+    // Указатель на данные с копированием при записи. Копии справочника разделяют все структуры,
+    // а Write() клонирует структуру только если её ещё кто-то использует
+    template <typename T>
+    class CopyOnWrite {
     public:
-        void AddStop(std::string name, Coordinates coordinates);
+        CopyOnWrite()
+            : ptr_(std::make_shared<T>()) {
+        }
 
-        void SetStopsDistance(std::string_view stop_name_from, std::string_view stop_name_to, int distance);
+        const T& operator*() const {
+            return *ptr_;
+        }
 
-        void AddBus(std::string name, const std::vector<std::string_view>& stops_names, bool is_roundtrip = false);
+        const T* operator->() const {
+            return ptr_.get();
+        }
+
+        T& Write() {
+            if (ptr_.use_count() > 1) {
+                ptr_ = std::make_shared<T>(*ptr_);
+            }
+            return *ptr_;
+        }
+
+    private:
+        std::shared_ptr<T> ptr_;
+    };
+
+    // Сколько раз и за какое время строился производный индекс
+    struct IndexBuildStats {
+        std::string_view name;
+        bool is_built = false;
+        size_t build_count = 0;
+        std::chrono::nanoseconds build_time{};
+    };
+
+    // Производный индекс, который строится при первом обращении, а не при загрузке. Одновременные
+    // читатели одной версии справочника дожидаются единственного построения. Копия справочника
+    // разделяет уже построенный индекс; изменение справочника либо правит индекс через Write(),
+    // либо сбрасывает его до следующего обращения
+    template <typename T>
+    class LazyIndex {
+    public:
+        explicit LazyIndex(std::string_view name)
+            : name_(name) {
+        }
 
-        std::optional<BusInfo> FindBus(std::string_view name_view) const;
+        LazyIndex(const LazyIndex& other)
+            : name_(other.name_) {
+            std::lock_guard guard(other.mutex_);
+            value_ = other.value_;
+            build_count_ = other.build_count_;
+            build_time_ = other.build_time_;
+        }
 
-        std::optional<StopInfo> FindStop(std::string_view name_view) const;
+        LazyIndex& operator=(const LazyIndex& other) {
+            if (this != &other) {
+                std::scoped_lock guard(mutex_, other.mutex_);
+                name_ = other.name_;
+                value_ = other.value_;
+                build_count_ = other.build_count_;
+                build_time_ = other.build_time_;
+            }
+            return *this;
+        }
+
+        // build() возвращает T и вызывается не больше одного раза на построение
+        template <typename Build>
+        const T& Get(Build build) const {
+            if (auto value = std::atomic_load(&value_)) {
+                return *value;
+            }
 
-        const std::deque<Stop>& GetStops() const;
+            std::lock_guard guard(mutex_);
+            if (!value_) {
+                const auto start = std::chrono::steady_clock::now();
+                auto value = std::make_shared<T>(build());
+                build_time_ += std::chrono::steady_clock::now() - start;
+                ++build_count_;
+                std::atomic_store(&value_, std::move(value));
+            }
+            return *value_;
+        }
+
+        // Построенный индекс для правки на месте или nullptr, если индекс не построен
+        T* Write() {
+            if (!value_) {
+                return nullptr;
+            }
+            if (value_.use_count() > 1) {
+                value_ = std::make_shared<T>(*value_);
+            }
+            return value_.get();
+        }
 
-        const std::map<std::string_view, const Bus*>& GetBuses() const;
+        void Reset() {
+            value_.reset();
+        }
+
+        // Построенный индекс или nullptr. Для изменяющих справочник методов; читатели пользуются Get()
+        const T* TryGet() const {
+            return value_.get();
+        }
+
+        IndexBuildStats GetStats() const {
+            std::lock_guard guard(mutex_);
+            return {name_, value_ != nullptr, build_count_, build_time_};
+        }
 
     private:
-        class StopPtrPairHasher {
+        std::string_view name_;
+        // Читается без блокировки через std::atomic_load; пишется под mutex_ или
+        // в неконстантных методах, которые не выполняются одновременно с чтением
+        mutable std::shared_ptr<T> value_;
+        mutable std::mutex mutex_;
+        mutable size_t build_count_ = 0;
+        mutable std::chrono::nanoseconds build_time_{};
+    };
+
+    // Запросы к справочнику только на чтение. Их обслуживают и Catalogue,
+    // и MappedCatalogue, работающий прямо поверх отображённого в память снимка
+    class CatalogueReader {
+    public:
+        virtual ~CatalogueReader() = default;
+
+        virtual std::optional<BusInfo> FindBus(std::string_view name_view) const = 0;
+
+        virtual std::optional<StopInfo> FindStop(std::string_view name_view) const = 0;
+
+        virtual uint64_t GetVersion() const = 0;
+
+        // Остановки пронумерованы по Stop::id от 0 до GetStopCount(); номера удалённых остановок
+        // не встречаются в маршрутах и не используются повторно
+        virtual size_t GetStopCount() const = 0;
+
+        virtual std::string_view GetStopName(size_t stop_id) const = 0;
+
+        virtual Coordinates GetStopCoordinates(size_t stop_id) const = 0;
+
+        // Дорожное расстояние между остановками; если в прямую сторону оно не задано — в обратную
+        virtual std::optional<int> GetDistance(size_t stop_id_from, size_t stop_id_to) const = 0;
+
+        // Перебирает маршруты в порядке возрастания названий
+        virtual void ForEachRoute(const std::function<void(Route)>& callback) const = 0;
+
+        // Рейтинги и итоги сети; строятся при первом обращении, один раз на версию справочника
+        virtual const NetworkStats& GetNetworkStats() const = 0;
+
+        // Матрица инцидентности «остановка × автобус» для запросов о прямых связях
+        virtual const StopBusIncidence& GetIncidence() const = 0;
+    };
+
+    // Собирает итоги и параллельно упорядочивает рейтинги. buses — в порядке названий
+    NetworkStats MakeNetworkStats(std::vector<BusInfo> buses, std::vector<NetworkStats::StopRank> served_stops,
+                                  size_t bus_count, size_t stop_count);
+
+    class Catalogue : public CatalogueReader {
+    public:
+        class StopIdPairHasher {
         public:
-            size_t operator()(const std::pair<const Stop*, const Stop*> &pair) const {
+            size_t operator()(const std::pair<size_t, size_t> &pair) const {
                 size_t h_first = hasher_(pair.first);
                 size_t h_second = hasher_(pair.second);
 
@@ -40,15 +186,201 @@ namespace transport {
             }
 
         private:
-            std::hash<const Stop*> hasher_;
+            std::hash<size_t> hasher_;
+        };
+
+        // Расстояния между остановками, заданными своими Stop::id
+        using DistanceTable = std::unordered_map<std::pair<size_t, size_t>, int, StopIdPairHasher>;
+
+        // Маршрут для пакетной загрузки AddBuses
+        struct BusInput {
+            std::string name;
+            std::vector<std::string_view> stops_names;
+            bool is_roundtrip = false;
+            // Отправления рейсов, см. Bus::departures
+            std::vector<double> departures;
+        };
+
+        // Резервирует место под ожидаемое число новых остановок и расстояний
+        void Reserve(size_t stop_count, size_t distance_count);
+
+        void AddStop(std::string name, Coordinates coordinates);
+
+        // Меняет координаты остановки, сохраняя её Stop::id
+        void UpdateStop(std::string_view name, Coordinates coordinates);
+
+        // Удаляет остановку, через которую не проходит ни один автобус. Её Stop::id больше не используется
+        void RemoveStop(std::string_view name);
+
+        void SetStopsDistance(std::string_view stop_name_from, std::string_view stop_name_to, int distance);
+
+        void RemoveStopsDistance(std::string_view stop_name_from, std::string_view stop_name_to);
+
+        // Маршрут с уже известным названием заменяется. Построенный индекс автобусов остановок каждый
+        // вызов правит заново, поэтому много маршрутов быстрее добавлять через AddBuses
+        void AddBus(std::string name, const std::vector<std::string_view>& stops_names, bool is_roundtrip = false);
+
+        // Пакетная загрузка: названия остановок разрешаются параллельно, а индекс автобусов остановок
+        // перестраивается один раз. Из маршрутов с одинаковым названием остаётся последний
+        void AddBuses(const std::vector<BusInput>& buses);
+
+        void RemoveBus(std::string_view name);
+
+        // Применяет изменения по месту, затрагивая только изменённые остановки, расстояния и маршруты.
+        // Остановки добавляются и меняются до расстояний и маршрутов, а удаляются после них.
+        // Пакет сначала проверяется целиком: если в нём есть ошибочные элементы, справочник не меняется,
+        // а ошибки возвращаются в DeltaReport::errors
+        DeltaReport ApplyDelta(const CatalogueDelta& delta);
+
+        // Описания элементов пакета, которые нельзя применить: неизвестные остановки и маршруты,
+        // маршруты без остановок и удаление остановок, через которые пойдут автобусы
+        std::vector<std::string> ValidateDelta(const CatalogueDelta& delta) const;
+
+        // Замораживает набор названий после загрузки: строит минимальные совершенные хеш-функции
+        // для FindStop/FindBus и упорядоченный массив автобусов для ForEachRoute. Добавление или
+        // удаление остановки или автобуса снимает заморозку, и до следующего Freeze() поиск идёт
+        // по словарям. Изменение координат и расстояний заморозку не снимает
+        void Freeze();
+
+        // Считать длины маршрутов по компактной геометрии остановок вместо исходных координат
+        void SetCompactGeometry(bool compact_geometry);
+
+        // Плотные массивы координат остановок; строятся при первом обращении
+        const StopGeometry& GetStopGeometry() const;
+
+        std::optional<BusInfo> FindBus(std::string_view name_view) const override;
+
+        std::optional<StopInfo> FindStop(std::string_view name_view) const override;
+
+        // Удалённые остановки остаются пустыми указателями, чтобы не сдвигать Stop::id
+        const std::vector<std::shared_ptr<const Stop>>& GetStops() const;
+
+        const std::map<std::string_view, std::shared_ptr<const Bus>>& GetBuses() const;
+
+        const DistanceTable& GetDistances() const;
+
+        // Увеличивается при каждом изменении справочника
+        uint64_t GetVersion() const override;
+
+        // Сведения о построении производных индексов: автобусов остановок, статистики маршрутов,
+        // геометрии, рейтингов сети и матрицы инцидентности
+        std::vector<IndexBuildStats> GetIndexStats() const;
+
+        size_t GetStopCount() const override;
+
+        std::string_view GetStopName(size_t stop_id) const override;
+
+        Coordinates GetStopCoordinates(size_t stop_id) const override;
+
+        std::optional<int> GetDistance(size_t stop_id_from, size_t stop_id_to) const override;
+
+        void ForEachRoute(const std::function<void(Route)>& callback) const override;
+
+        const NetworkStats& GetNetworkStats() const override;
+
+        const StopBusIncidence& GetIncidence() const override;
+
+    private:
+        // Автобусы остановок в формате CSR: id автобусов остановки stop_id, упорядоченные по названиям,
+        // лежат в bus_ids[offsets[stop_id]..offsets[stop_id + 1])
+        struct StopBusesIndex {
+            std::vector<uint32_t> offsets{0};
+            std::vector<uint32_t> bus_ids;
         };
 
-        std::deque<Stop> stops_;
-        std::unordered_map<std::string_view, const Stop*> stopname_to_stop_;
-        std::deque<Bus> buses_;
-        std::map<std::string_view, const Bus*> busname_to_bus_;
-        std::unordered_map<const Stop*, std::set<std::string_view>> stop_to_buses_names;
-        std::unordered_map<std::pair<const Stop*, const Stop*>, int, StopPtrPairHasher> stopptrpair_to_distance;
+        void AddBusWithStops(std::string name, std::vector<size_t> stop_ids, bool is_roundtrip);
+
+        // Добавляет автобус в справочник, не трогая индекс автобусов остановок
+        const Bus* RegisterBus(std::string name, std::vector<size_t> stop_ids, bool is_roundtrip,
+                               std::vector<double> departures = {});
+
+        // Убирает автобус из справочника, не трогая индекс автобусов остановок
+        std::shared_ptr<const Bus> UnregisterBus(std::string_view name);
+
+        // Убирает из индекса автобусов остановок removed_buses и добавляет added_buses.
+        // Небольшие изменения правят построенный индекс на месте, большие сбрасывают его до следующего запроса
+        void UpdateStopBuses(const std::vector<std::shared_ptr<const Bus>>& removed_buses, std::vector<const Bus*> added_buses);
+
+        void UpdateStopBusesInPlace(const std::vector<std::shared_ptr<const Bus>>& removed_buses,
+                                    const std::vector<const Bus*>& added_buses, const std::vector<bool>& is_removed);
+
+        StopBusesIndex BuildStopBuses() const;
+
+        BusNamesView GetStopBuses(size_t stop_id) const;
+
+        // Статистика маршрута или nullopt, если не задано расстояние между соседними остановками
+        std::optional<BusInfo> ComputeBusInfo(const Bus& bus) const;
+
+        std::vector<std::optional<BusInfo>> BuildRouteStats() const;
+
+        StopGeometry BuildStopGeometry() const;
+
+        NetworkStats BuildNetworkStats() const;
+
+        // Любое изменение справочника сбрасывает индексы, которые строятся заново для каждой версии
+        void IncrementVersion();
+
+        // Пересчитывает построенную статистику маршрутов, проходящих через остановку
+        void UpdateRouteStats(size_t stop_id);
+
+        // Автобусы, проходящие через обе остановки
+        std::vector<std::string_view> GetCommonBuses(size_t stop_id_first, size_t stop_id_second) const;
+
+        const Stop* FindStopPtr(std::string_view name) const;
+
+        const Bus* FindBusPtr(std::string_view name) const;
+
+        // Неизменный после Freeze() набор названий
+        struct FrozenNames {
+            // По Stop::id
+            PerfectNameIndex stops;
+            // По позиции в sorted_buses
+            PerfectNameIndex buses;
+            std::vector<const Bus*> sorted_buses;
+        };
+
+        // Остановки и автобусы неизменяемы и разделяются всеми версиями справочника, поэтому указатели
+        // и string_view на них остаются действительными в копиях. Изменённый объект заменяется новым
+        // вместе со всеми ключами, которые на него ссылаются
+        CopyOnWrite<std::vector<std::shared_ptr<const Stop>>> stops_;
+        CopyOnWrite<std::unordered_map<std::string_view, const Stop*>> stopname_to_stop_;
+        CopyOnWrite<std::map<std::string_view, std::shared_ptr<const Bus>>> busname_to_bus_;
+        // Индекс — Bus::id; у удалённых автобусов название пустое, а их id больше не используются
+        CopyOnWrite<std::vector<std::string_view>> bus_names_;
+        CopyOnWrite<DistanceTable> stopidpair_to_distance;
+        // Производные индексы строятся при первом запросе, которому они нужны
+        LazyIndex<StopBusesIndex> stop_to_buses_{"stop_buses"};
+        // Индекс — Bus::id
+        LazyIndex<std::vector<std::optional<BusInfo>>> route_stats_{"route_stats"};
+        LazyIndex<StopGeometry> stop_geometry_{"stop_geometry"};
+        LazyIndex<NetworkStats> network_stats_{"network_stats"};
+        // Перестраивается после изменения маршрутов
+        LazyIndex<StopBusIncidence> incidence_{"incidence"};
+        bool compact_geometry_ = false;
+        // Пусто, если справочник не заморожен
+        std::shared_ptr<const FrozenNames> frozen_names_;
+        uint64_t version_ = 0;
+    };
+
+    // Версионированный справочник для одновременного чтения и обновления (read-copy-update).
+    // Читатели берут текущую неизменяемую версию и работают с ней сколько угодно долго; писатель
+    // применяет изменения к копии, разделяющей с текущей версией все незатронутые структуры,
+    // и атомарно публикует её. Обновления выполняются по одному
+    class VersionedCatalogue {
+    public:
+        VersionedCatalogue();
+
+        explicit VersionedCatalogue(Catalogue catalogue);
+
+        std::shared_ptr<const Catalogue> Get() const;
+
+        // Применяет update к копии текущей версии и публикует результат; если update бросил исключение,
+        // текущая версия не меняется
+        void Update(const std::function<void(Catalogue&)>& update);
+
+    private:
+        std::shared_ptr<const Catalogue> current_;
+        std::mutex writer_mutex_;
     };
 
 }
\ No newline at end of file
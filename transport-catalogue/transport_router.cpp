@@ -0,0 +1,352 @@
+#include "transport_router.h"
+#include "parallel.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using namespace transport;
+using namespace std::literals;
+
+namespace
+{
+    // Радиксная куча для Дейкстры: извлекаемые ключи не убывают, поэтому элемент хранится в корзине
+    // по старшему биту, в котором его ключ отличается от последнего извлечённого. Вставка — O(1),
+    // а каждый элемент за всё время перекладывается не больше 64 раз. Корзины сохраняют выделенную
+    // память между поисками
+    class RadixHeap
+    {
+    public:
+        void Clear()
+        {
+            for (auto& bucket : buckets_)
+            {
+                bucket.clear();
+            }
+            last_key_ = 0;
+            size_ = 0;
+        }
+
+        bool Empty() const
+        {
+            return size_ == 0;
+        }
+
+        // key не меньше последнего извлечённого
+        void Push(uint64_t key, uint32_t vertex)
+        {
+            buckets_[GetBucketIndex(key)].push_back({key, vertex});
+            ++size_;
+        }
+
+        std::pair<uint64_t, uint32_t> Pop()
+        {
+            if (buckets_[0].empty())
+            {
+                size_t index = 1;
+                while (buckets_[index].empty())
+                {
+                    ++index;
+                }
+
+                auto& bucket = buckets_[index];
+                last_key_ = std::min_element(bucket.begin(), bucket.end())->first;
+                for (const auto& item : bucket)
+                {
+                    buckets_[GetBucketIndex(item.first)].push_back(item);
+                }
+                bucket.clear();
+            }
+
+            const auto item = buckets_[0].back();
+            buckets_[0].pop_back();
+            --size_;
+            return item;
+        }
+
+    private:
+        size_t GetBucketIndex(uint64_t key) const
+        {
+            return key == last_key_ ? 0 : 64 - __builtin_clzll(key ^ last_key_);
+        }
+
+        std::array<std::vector<std::pair<uint64_t, uint32_t>>, 65> buckets_;
+        uint64_t last_key_ = 0;
+        size_t size_ = 0;
+    };
+
+    // Для неотрицательных double порядок битовых представлений совпадает с порядком чисел
+    uint64_t ToKey(double time)
+    {
+        uint64_t key;
+        std::memcpy(&key, &time, sizeof(key));
+        return key;
+    }
+
+    double FromKey(uint64_t key)
+    {
+        double time;
+        std::memcpy(&time, &key, sizeof(time));
+        return time;
+    }
+
+    const double METERS_PER_KILOMETER = 1000.0;
+    const double MINUTES_PER_HOUR = 60.0;
+}
+
+double RoutingSettings::GetMetersPerMinute() const
+{
+    return bus_velocity * METERS_PER_KILOMETER / MINUTES_PER_HOUR;
+}
+
+struct TransportRouter::RoutingGraph
+{
+    struct Edge
+    {
+        uint32_t to;
+        double time;
+    };
+
+    // Вершины [0, stop_count) — остановки по Stop::id, дальше — позиции автобусов на маршрутах
+    size_t stop_count = 0;
+    // Рёбра вершины v — edges[edge_offsets[v], edge_offsets[v + 1])
+    std::vector<uint32_t> edge_offsets;
+    std::vector<Edge> edges;
+};
+
+struct TransportRouter::SearchState
+{
+    std::vector<double> times;
+    std::vector<uint32_t> touched;
+    RadixHeap heap;
+
+    void Prepare(size_t vertex_count)
+    {
+        if (times.size() != vertex_count)
+        {
+            times.assign(vertex_count, std::numeric_limits<double>::infinity());
+        }
+        else
+        {
+            for (const uint32_t vertex : touched)
+            {
+                times[vertex] = std::numeric_limits<double>::infinity();
+            }
+        }
+        touched.clear();
+        heap.Clear();
+    }
+};
+
+TransportRouter::TransportRouter()
+    : graph_("routing_graph")
+{
+}
+
+TransportRouter::~TransportRouter() = default;
+
+void TransportRouter::SetRoutingSettings(RoutingSettings routing_settings)
+{
+    graph_.Reset([&] {
+        routing_settings_ = std::move(routing_settings);
+    });
+}
+
+template <typename OnSettled>
+void TransportRouter::Search(const RoutingGraph& graph, SearchState& state, size_t source, double time_limit,
+                             OnSettled on_settled) const
+{
+    state.Prepare(graph.edge_offsets.size() - 1);
+    auto& times = state.times;
+
+    times[source] = 0.0;
+    state.touched.push_back(uint32_t(source));
+    state.heap.Push(ToKey(0.0), uint32_t(source));
+
+    while (!state.heap.Empty())
+    {
+        const auto [key, vertex] = state.heap.Pop();
+        const double time = FromKey(key);
+        if (time > times[vertex])
+        {
+            continue;
+        }
+
+        if (vertex < graph.stop_count && !on_settled(vertex, time))
+        {
+            return;
+        }
+
+        // Вершины дальше лимита в кучу не попадают, поэтому поиск обрывается сам
+        for (uint32_t i = graph.edge_offsets[vertex]; i < graph.edge_offsets[vertex + 1]; ++i)
+        {
+            const auto& edge = graph.edges[i];
+            const double next_time = time + edge.time;
+            if (next_time < times[edge.to] && next_time <= time_limit)
+            {
+                if (times[edge.to] == std::numeric_limits<double>::infinity())
+                {
+                    state.touched.push_back(edge.to);
+                }
+                times[edge.to] = next_time;
+                state.heap.Push(ToKey(next_time), edge.to);
+            }
+        }
+    }
+}
+
+std::vector<std::pair<size_t, double>> TransportRouter::FindIsochrone(const CatalogueReader& catalogue, size_t stop_id,
+                                                                      double time_limit) const
+{
+    const auto graph = GetGraph(catalogue);
+    auto state = states_.Acquire();
+    std::vector<std::pair<size_t, double>> result;
+
+    Search(*graph, *state, stop_id, time_limit, [&result, stop_id](uint32_t vertex, double time) {
+        if (vertex != stop_id)
+        {
+            result.emplace_back(vertex, time);
+        }
+        return true;
+    });
+
+    states_.Release(std::move(state));
+
+    // Остановки извлекаются по возрастанию времени; при равном времени — по названию
+    std::stable_sort(result.begin(), result.end(), [&catalogue](const auto& lhs, const auto& rhs) {
+        return lhs.second < rhs.second
+               || (lhs.second == rhs.second && catalogue.GetStopName(lhs.first) < catalogue.GetStopName(rhs.first));
+    });
+    return result;
+}
+
+void TransportRouter::ComputeTravelTimes(const CatalogueReader& catalogue, const std::vector<size_t>& sources,
+                                         const std::vector<size_t>& targets,
+                                         const std::function<void(size_t, std::vector<double>)>& on_row) const
+{
+    const auto graph = GetGraph(catalogue);
+
+    std::vector<bool> is_target(graph->stop_count, false);
+    size_t target_count = 0;
+    for (const size_t stop_id : targets)
+    {
+        if (!is_target[stop_id])
+        {
+            is_target[stop_id] = true;
+            ++target_count;
+        }
+    }
+
+    ParallelForRanges(sources.size(), [&](size_t first, size_t last) {
+        auto state = states_.Acquire();
+
+        for (size_t i = first; i < last; ++i)
+        {
+            size_t remaining = target_count;
+            Search(*graph, *state, sources[i], std::numeric_limits<double>::infinity(),
+                   [&is_target, &remaining](uint32_t vertex, double) {
+                return !is_target[vertex] || --remaining > 0;
+            });
+
+            // Недостигнутые цели остались с бесконечным временем
+            std::vector<double> row;
+            row.reserve(targets.size());
+            for (const size_t stop_id : targets)
+            {
+                row.push_back(state->times[stop_id]);
+            }
+            on_row(i, std::move(row));
+        }
+
+        states_.Release(std::move(state));
+    });
+}
+
+IndexBuildStats TransportRouter::GetGraphStats() const
+{
+    return graph_.GetStats();
+}
+
+std::shared_ptr<const TransportRouter::RoutingGraph> TransportRouter::GetGraph(const CatalogueReader& catalogue) const
+{
+    return graph_.Get(catalogue, [this](const CatalogueReader& reader) {
+        return BuildGraph(reader);
+    });
+}
+
+std::shared_ptr<const TransportRouter::RoutingGraph> TransportRouter::BuildGraph(const CatalogueReader& catalogue) const
+{
+    if (!routing_settings_)
+    {
+        throw std::logic_error("Routing settings are not set"s);
+    }
+
+    auto graph = std::make_shared<RoutingGraph>();
+    graph->stop_count = catalogue.GetStopCount();
+
+    const double wait_time = routing_settings_->bus_wait_time;
+    const double meters_per_minute = routing_settings_->GetMetersPerMinute();
+
+    struct EdgeRecord
+    {
+        uint32_t from;
+        uint32_t to;
+        double time;
+    };
+
+    std::vector<EdgeRecord> records;
+    size_t vertex_count = graph->stop_count;
+
+    // Цепочка позиций автобуса вдоль stop_ids: сесть можно везде, кроме конца, выйти — везде, кроме начала.
+    // Отрезок без известного расстояния не проезжается
+    auto add_chain = [&](auto first, auto last) {
+        const size_t size = last - first;
+        const uint32_t base = uint32_t(vertex_count);
+        vertex_count += size;
+
+        for (size_t i = 0; i < size; ++i, ++first)
+        {
+            const uint32_t stop_vertex = uint32_t(*first);
+            if (i > 0)
+            {
+                records.push_back({base + uint32_t(i), stop_vertex, 0.0});
+            }
+            if (i + 1 < size)
+            {
+                records.push_back({stop_vertex, base + uint32_t(i), wait_time});
+                if (const auto distance = catalogue.GetDistance(*first, *(first + 1)))
+                {
+                    records.push_back({base + uint32_t(i), base + uint32_t(i + 1), *distance / meters_per_minute});
+                }
+            }
+        }
+    };
+
+    catalogue.ForEachRoute([&](Route route) {
+        add_chain(route.stop_ids.begin(), route.stop_ids.end());
+        if (!route.is_roundtrip)
+        {
+            add_chain(route.stop_ids.rbegin(), route.stop_ids.rend());
+        }
+    });
+
+    graph->edge_offsets.assign(vertex_count + 1, 0);
+    for (const auto& record : records)
+    {
+        ++graph->edge_offsets[record.from + 1];
+    }
+    for (size_t vertex = 0; vertex < vertex_count; ++vertex)
+    {
+        graph->edge_offsets[vertex + 1] += graph->edge_offsets[vertex];
+    }
+
+    graph->edges.resize(records.size());
+    std::vector<uint32_t> positions(graph->edge_offsets.begin(), graph->edge_offsets.end() - 1);
+    for (const auto& record : records)
+    {
+        graph->edges[positions[record.from]++] = {record.to, record.time};
+    }
+
+    return graph;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "index_cache.h"
+#include "transport_catalogue.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace transport
+{
+    struct RoutingSettings
+    {
+        // Ожидание автобуса на остановке, минуты
+        int bus_wait_time = 0;
+        // Скорость автобуса, км/ч
+        double bus_velocity = 0.0;
+
+        // Скорость автобуса в метрах в минуту
+        double GetMetersPerMinute() const;
+    };
+
+    // Поиск времени в пути по сети маршрутов. Граф строится по маршрутам и дорожным расстояниям:
+    // вершины — остановки и позиции автобусов на маршрутах; посадка стоит bus_wait_time, проезд до
+    // следующей остановки — расстояние, делённое на скорость, выход бесплатен. Некольцевой маршрут
+    // даёт две цепочки позиций, туда и обратно. Граф строится при первом поиске, один раз на версию
+    // справочника. Время везде в минутах
+    class TransportRouter
+    {
+    public:
+        TransportRouter();
+
+        ~TransportRouter();
+
+        void SetRoutingSettings(RoutingSettings routing_settings);
+
+        // Остановки, до которых из stop_id можно доехать не дольше чем за time_limit, кроме самой stop_id,
+        // со временем в пути, по возрастанию времени. Без настроек маршрутизации бросает std::logic_error
+        std::vector<std::pair<size_t, double>> FindIsochrone(const CatalogueReader& catalogue, size_t stop_id,
+                                                             double time_limit) const;
+
+        // Матрица времени в пути: для каждой sources[i] один поиск до всех targets, обрывающийся, когда все
+        // они достигнуты. Источники обрабатываются параллельно, и on_row(i, times) вызывается из рабочих
+        // потоков по мере готовности строк, в произвольном порядке; times[j] — время до targets[j]
+        // или бесконечность, если доехать нельзя. Без настроек маршрутизации бросает std::logic_error
+        void ComputeTravelTimes(const CatalogueReader& catalogue, const std::vector<size_t>& sources,
+                                const std::vector<size_t>& targets,
+                                const std::function<void(size_t, std::vector<double>)>& on_row) const;
+
+        // Сведения о построении графа маршрутизации
+        IndexBuildStats GetGraphStats() const;
+
+    private:
+        struct RoutingGraph;
+        struct SearchState;
+
+        std::shared_ptr<const RoutingGraph> GetGraph(const CatalogueReader& catalogue) const;
+
+        std::shared_ptr<const RoutingGraph> BuildGraph(const CatalogueReader& catalogue) const;
+
+        // Дейкстра из source с отсечением по time_limit. on_settled(vertex, time) вызывается для каждой
+        // вершины-остановки при окончательном определении её времени; false прекращает поиск
+        template <typename OnSettled>
+        void Search(const RoutingGraph& graph, SearchState& state, size_t source, double time_limit,
+                    OnSettled on_settled) const;
+
+        // Настройки меняются и читаются под блокировкой graph_
+        std::optional<RoutingSettings> routing_settings_;
+        CatalogueIndexCache<RoutingGraph> graph_;
+        SearchStatePool<SearchState> states_;
+    };
+}